@@ -0,0 +1,264 @@
+#include "corpus.hpp"
+#include "emitter.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "structural_index.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Per-stage throughput of the rendering pipeline over generated corpora.
+//
+//   terminyl_bench [--sizes 1K,64K,1M,16M] [--mix prose,markup,...|all]
+//                  [--seed N] [--min-time SECONDS] [--format json|csv]
+//
+// Sizes take K/M/G suffixes (powers of 1024), up to 1G. Every stage is
+// repeated until it has run for at least --min-time, and only the stage
+// itself is inside the timed region.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::vector<std::size_t> sizes{1 << 10, 64 << 10, 1 << 20, 16 << 20};
+  std::vector<CorpusInfo> mixes;
+  std::uint64_t seed = 1;
+  double min_time = 0.25;
+  bool csv = false;
+};
+
+struct Sample {
+  std::string_view corpus;
+  std::size_t size;
+  std::size_t bytes;
+  std::string_view stage;
+  std::size_t iterations;
+  double seconds;
+};
+
+// Keeps results alive so the optimiser cannot drop a stage
+volatile std::size_t g_sink = 0;
+
+std::optional<std::size_t> parse_size(std::string_view s) {
+  std::size_t mult = 1;
+  if (!s.empty()) {
+    switch (s.back()) {
+    case 'K': case 'k': mult = std::size_t{1} << 10; break;
+    case 'M': case 'm': mult = std::size_t{1} << 20; break;
+    case 'G': case 'g': mult = std::size_t{1} << 30; break;
+    default: break;
+    }
+    if (mult != 1)
+      s.remove_suffix(1);
+  }
+  std::string digits(s);
+  char *end = nullptr;
+  unsigned long long n = std::strtoull(digits.c_str(), &end, 10);
+  if (digits.empty() || *end != '\0' || n == 0)
+    return std::nullopt;
+  return static_cast<std::size_t>(n) * mult;
+}
+
+template <class F> void for_each_item(std::string_view list, F f) {
+  while (!list.empty()) {
+    auto comma = list.find(',');
+    f(list.substr(0, comma));
+    if (comma == std::string_view::npos)
+      break;
+    list.remove_prefix(comma + 1);
+  }
+}
+
+bool parse_args(int argc, char **argv, Options &opts) {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    auto value = [&]() -> std::optional<std::string_view> {
+      if (++i == argc)
+        return std::nullopt;
+      return std::string_view(argv[i]);
+    };
+    if (arg == "--sizes") {
+      auto v = value();
+      if (!v)
+        return false;
+      opts.sizes.clear();
+      bool ok = true;
+      for_each_item(*v, [&](std::string_view item) {
+        auto n = parse_size(item);
+        ok = ok && n.has_value();
+        if (n)
+          opts.sizes.push_back(*n);
+      });
+      if (!ok || opts.sizes.empty())
+        return false;
+    } else if (arg == "--mix") {
+      auto v = value();
+      if (!v)
+        return false;
+      if (*v == "all")
+        continue;
+      bool ok = true;
+      for_each_item(*v, [&](std::string_view item) {
+        bool found = false;
+        for (const auto &m : corpus_mixes()) {
+          if (m.name == item) {
+            opts.mixes.push_back(m);
+            found = true;
+          }
+        }
+        ok = ok && found;
+      });
+      if (!ok)
+        return false;
+    } else if (arg == "--seed") {
+      auto v = value();
+      if (!v)
+        return false;
+      opts.seed = std::strtoull(std::string(*v).c_str(), nullptr, 10);
+    } else if (arg == "--min-time") {
+      auto v = value();
+      if (!v)
+        return false;
+      opts.min_time = std::strtod(std::string(*v).c_str(), nullptr);
+    } else if (arg == "--format") {
+      auto v = value();
+      if (!v || (*v != "json" && *v != "csv"))
+        return false;
+      opts.csv = *v == "csv";
+    } else {
+      return false;
+    }
+  }
+  if (opts.mixes.empty())
+    opts.mixes.assign(corpus_mixes().begin(), corpus_mixes().end());
+  return true;
+}
+
+// Runs `body` until min_time has been spent in it, timing each run
+template <class Body>
+std::pair<std::size_t, double> measure(double min_time, Body body) {
+  std::size_t iterations = 0;
+  double seconds = 0;
+  do {
+    auto t0 = Clock::now();
+    body();
+    auto t1 = Clock::now();
+    seconds += std::chrono::duration<double>(t1 - t0).count();
+    ++iterations;
+  } while (seconds < min_time);
+  return {iterations, seconds};
+}
+
+void run_corpus(const Options &opts, const CorpusInfo &mix, std::size_t size,
+                std::vector<Sample> &out) {
+  const std::string source = generate_corpus(mix.mix, size, opts.seed);
+  const Emitter emitter;
+  Style plain_style;
+  plain_style.format = OutputFormat::Plain;
+  const Emitter plain(plain_style);
+
+  auto record = [&](std::string_view stage,
+                    std::pair<std::size_t, double> timing) {
+    out.push_back(
+        {mix.name, size, source.size(), stage, timing.first, timing.second});
+  };
+
+  auto lex = [&] { return Lexer(source).lexTokens(); };
+  const TokenBuffer tokens = lex();
+
+  record("lex", measure(opts.min_time,
+                        [&] { g_sink = g_sink + lex().size(); }));
+
+  record("parse", measure(opts.min_time, [&] {
+           g_sink = g_sink + Parser(tokens).parse().blocks().size();
+         }));
+
+  const Document doc = Parser(tokens).parse();
+  record("emit", measure(opts.min_time, [&] {
+           g_sink = g_sink + emitter.render_to_string(doc).size();
+         }));
+
+  record("emit_plain", measure(opts.min_time, [&] {
+           g_sink = g_sink + plain.render_to_string(doc).size();
+         }));
+
+  record("end_to_end", measure(opts.min_time, [&] {
+           Lexer lexer(source);
+           Document d = Parser(lexer).parse();
+           g_sink = g_sink + emitter.render_to_string(d).size();
+         }));
+}
+
+double mb_per_s(const Sample &s) {
+  return static_cast<double>(s.bytes) * static_cast<double>(s.iterations) /
+         s.seconds / 1e6;
+}
+
+double ns_per_byte(const Sample &s) {
+  return s.seconds * 1e9 /
+         (static_cast<double>(s.bytes) * static_cast<double>(s.iterations));
+}
+
+void print_json(const Options &opts, const std::vector<Sample> &samples) {
+  std::printf("{\n  \"version\": 1,\n  \"seed\": %llu,\n"
+              "  \"min_time\": %g,\n  \"lexer_kernel\": \"%s\",\n"
+              "  \"results\": [\n",
+              static_cast<unsigned long long>(opts.seed), opts.min_time,
+              StructuralIndex::kernel_name());
+  for (std::size_t i = 0; i < samples.size(); ++i) {
+    const Sample &s = samples[i];
+    std::printf("    {\"corpus\": \"%.*s\", \"size\": %zu, \"bytes\": %zu, "
+                "\"stage\": \"%.*s\", \"iterations\": %zu, "
+                "\"seconds\": %.6f, \"mb_per_s\": %.2f, "
+                "\"ns_per_byte\": %.4f}%s\n",
+                static_cast<int>(s.corpus.size()), s.corpus.data(), s.size,
+                s.bytes, static_cast<int>(s.stage.size()), s.stage.data(),
+                s.iterations, s.seconds, mb_per_s(s), ns_per_byte(s),
+                i + 1 == samples.size() ? "" : ",");
+  }
+  std::printf("  ]\n}\n");
+}
+
+void print_csv(const std::vector<Sample> &samples) {
+  std::printf("corpus,size,bytes,stage,iterations,seconds,mb_per_s,"
+              "ns_per_byte\n");
+  for (const Sample &s : samples) {
+    std::printf("%.*s,%zu,%zu,%.*s,%zu,%.6f,%.2f,%.4f\n",
+                static_cast<int>(s.corpus.size()), s.corpus.data(), s.size,
+                s.bytes, static_cast<int>(s.stage.size()), s.stage.data(),
+                s.iterations, s.seconds, mb_per_s(s), ns_per_byte(s));
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opts;
+  if (!parse_args(argc, argv, opts)) {
+    std::cerr << "Usage: terminyl_bench [--sizes 1K,64K,1M,16M] "
+                 "[--mix prose,markup,nested,code,headings|all]\n"
+                 "                      [--seed N] [--min-time SECONDS] "
+                 "[--format json|csv]\n";
+    return 64;
+  }
+
+  std::vector<Sample> samples;
+  for (const auto &mix : opts.mixes) {
+    for (std::size_t size : opts.sizes) {
+      std::cerr << "bench: " << mix.name << " " << size << " bytes\n";
+      run_corpus(opts, mix, size, samples);
+    }
+  }
+
+  if (opts.csv)
+    print_csv(samples);
+  else
+    print_json(opts, samples);
+  return 0;
+}
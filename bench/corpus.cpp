@@ -0,0 +1,147 @@
+#include "corpus.hpp"
+#include <array>
+#include <random>
+
+namespace {
+
+constexpr std::array<std::string_view, 32> kWords = {
+    "the",      "terminal", "renderer", "wraps",   "each",    "paragraph",
+    "to",       "a",        "fixed",    "width",   "and",     "styles",
+    "runs",     "with",     "ANSI",     "escape",  "codes",   "so",
+    "output",   "stays",    "readable", "in",      "logs,",   "pagers",
+    "or",       "CI.",      "Headings", "get",     "boxes;",  "code",
+    "survives", "intact.",
+};
+
+constexpr std::array<CorpusInfo, 5> kMixes = {{
+    {CorpusMix::Prose, "prose"},
+    {CorpusMix::Markup, "markup"},
+    {CorpusMix::Nested, "nested"},
+    {CorpusMix::Code, "code"},
+    {CorpusMix::Headings, "headings"},
+}};
+
+class Generator {
+public:
+  Generator(std::uint64_t seed, std::string &out) : rng_(seed), out_(out) {}
+
+  std::size_t pick(std::size_t n) { return rng_() % n; }
+
+  void word() { out_ += kWords[pick(kWords.size())]; }
+
+  void words(std::size_t n, bool may_wrap = true) {
+    for (std::size_t i = 0; i < n; ++i) {
+      if (i != 0)
+        out_ += may_wrap && line_break_due() ? '\n' : ' ';
+      word();
+    }
+  }
+
+  // Occasional single newlines inside a paragraph, as in hand-wrapped text
+  bool line_break_due() { return pick(12) == 0; }
+
+  void styled(char marker, std::size_t n) {
+    out_ += marker;
+    words(n);
+    out_ += marker;
+  }
+
+  void nested(std::size_t depth) {
+    const char marker = depth % 2 == 0 ? '*' : '_';
+    out_ += marker;
+    word();
+    if (depth > 1) {
+      out_ += ' ';
+      nested(depth - 1);
+    }
+    out_ += ' ';
+    word();
+    out_ += marker;
+  }
+
+  void code(std::size_t len) {
+    out_ += '`';
+    for (std::size_t i = 0; i < len; ++i)
+      out_ += "abcdefghij_*(){}[];,.=+-"[pick(24)];
+    out_ += '`';
+  }
+
+  void heading() {
+    out_.append(1 + pick(4), '=');
+    out_ += ' ';
+    words(1 + pick(5), false);
+    out_ += '\n';
+  }
+
+  void end_block() { out_ += "\n\n"; }
+
+private:
+  std::mt19937_64 rng_;
+  std::string &out_;
+};
+
+void paragraph(Generator &g, std::string &out, CorpusMix mix) {
+  switch (mix) {
+  case CorpusMix::Prose:
+    g.words(80 + g.pick(120));
+    if (g.pick(4) == 0) {
+      out += ' ';
+      g.styled('*', 1 + g.pick(3));
+    }
+    break;
+  case CorpusMix::Markup:
+    for (std::size_t i = 0, n = 20 + g.pick(40); i < n; ++i) {
+      if (i != 0)
+        out += ' ';
+      switch (g.pick(4)) {
+      case 0:
+        g.styled('*', 1 + g.pick(2));
+        break;
+      case 1:
+        g.styled('_', 1 + g.pick(2));
+        break;
+      case 2:
+        g.code(3 + g.pick(10));
+        break;
+      default:
+        g.word();
+        break;
+      }
+    }
+    break;
+  case CorpusMix::Nested:
+    for (std::size_t i = 0, n = 2 + g.pick(4); i < n; ++i) {
+      if (i != 0)
+        out += ' ';
+      g.nested(4 + g.pick(28));
+    }
+    break;
+  case CorpusMix::Code:
+    g.words(5 + g.pick(10));
+    out += ' ';
+    g.code(200 + g.pick(2000));
+    out += ' ';
+    g.words(5 + g.pick(10));
+    break;
+  case CorpusMix::Headings:
+    g.heading();
+    out += '\n';
+    g.words(5 + g.pick(25));
+    break;
+  }
+  g.end_block();
+}
+
+} // namespace
+
+std::span<const CorpusInfo> corpus_mixes() { return kMixes; }
+
+std::string generate_corpus(CorpusMix mix, std::size_t bytes,
+                            std::uint64_t seed) {
+  std::string out;
+  out.reserve(bytes + 16 * 1024);
+  Generator g(seed, out);
+  while (out.size() < bytes)
+    paragraph(g, out, mix);
+  return out;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Synthetic .termy documents for benchmarks. The same (mix, size, seed)
+// always produces the same bytes, on every platform.
+enum class CorpusMix {
+  Prose,      // long plain paragraphs, sparse markup
+  Markup,     // bold/italic/code on most words
+  Nested,     // deeply nested bold/italic runs
+  Code,       // long code spans
+  Headings,   // many headings with short paragraphs
+};
+
+struct CorpusInfo {
+  CorpusMix mix;
+  std::string_view name;
+};
+
+std::span<const CorpusInfo> corpus_mixes();
+
+// Generates roughly `bytes` bytes (never fewer, at most one paragraph more),
+// always ending on a complete block.
+std::string generate_corpus(CorpusMix mix, std::size_t bytes,
+                            std::uint64_t seed = 1);
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class Emitter;
+class RenderCache;
+
+struct BatchOptions {
+    std::filesystem::path out_dir;
+    std::size_t jobs = 1;
+    // Replaces the input's extension in the output name
+    std::string extension = ".ansi";
+    RenderCache* cache = nullptr;
+    // With more than one, every input is parsed once and written once per
+    // width, as <name>.<width><extension>; the cache is not used then
+    std::vector<std::size_t> widths;
+};
+
+// Where the rendering of `input` goes: inputs keep their directory structure
+// under out_dir, absolute ones without the root and ones reaching outside
+// the working directory without the leading "..". A non-zero `width` is
+// added before the extension.
+std::filesystem::path batch_output_path(const std::string& input,
+                                        const BatchOptions& opts,
+                                        std::size_t width = 0);
+
+// Renders every input on a shared pool of opts.jobs workers, each reusing
+// its own output buffer. A file that fails is reported on `errors` and does
+// not stop the rest; so are inputs sharing an output path, which are not
+// rendered. Returns the number of failed files.
+std::size_t render_batch(const std::vector<std::string>& inputs,
+                         const Emitter& emitter, const BatchOptions& opts,
+                         std::ostream& errors);
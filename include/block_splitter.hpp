@@ -0,0 +1,213 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "delimiter.hpp"
+#include "structural_index.hpp"
+
+// Finds the offsets at which the parser is back at block level, so a source
+// can be cut there and every piece lexed, parsed and rendered on its own with
+// the same output as rendering the whole source at once.
+//
+// A newline ends a block unless a code span is open or a `*`/`_` delimiter
+// open at it closes before the next blank line, in which case the paragraph
+// continues on the next line; a blank line always ends it. The splitter pairs
+// delimiters the same way Parser::scanInlines does, with the same
+// delimiter_role, and is what the parser asks about such newlines. Whether
+// one of them ends the block is only known once a closer or the blank line
+// is reached, so it is reported then. A backtick opens a code span when
+// another one follows before the next blank line, as in
+// Parser::codeSpanCloses, or not when the source ends first.
+//
+// When a feed that is not marked final ends before the blank line, the
+// splitter takes the open delimiters as closing and the backtick as opening
+// a code span; if either turns out wrong, the splitter merely misses the
+// boundaries up to the blank line, which only makes for a coarser split.
+class BlockSplitter {
+public:
+  // Consumes `text`, which continues whatever was fed before. Returns the
+  // length of the longest prefix of `text` that ends on a block boundary, or
+  // 0 if `text` contains none.
+  std::size_t feed(std::string_view text) {
+    return feed(text, [](std::size_t, std::uint64_t) {});
+  }
+
+  // Same, and calls on_boundary(offset, next_line) for every boundary in
+  // `text`, where offset is just past the newline ending the block. If
+  // on_boundary returns bool, false stops there, as if `text` ended at that
+  // boundary. `at_end` says nothing follows `text`, so the end of the source
+  // counts as a blank line and misses no boundary.
+  template <class OnBoundary>
+  std::size_t feed(std::string_view text, OnBoundary &&on_boundary,
+                   bool at_end = false);
+
+  // Line number of the first line after the last boundary feed() reported.
+  std::uint64_t boundary_line() const { return boundary_line_; }
+
+  // Starts over on a new source, keeping the capacity grown so far.
+  void reset() {
+    restart(1);
+    boundary_line_ = 1;
+  }
+
+private:
+  // A newline in the current feed that ends its block unless one of the
+  // `depth` delimiters open at it closes before the blank line
+  struct Undecided {
+    std::size_t cut;
+    std::uint64_t line;
+    std::size_t depth;
+  };
+
+  void delimiter(char c, char before, char after);
+  static bool code_span_opens(std::string_view rest, bool at_end);
+  void restart(std::uint64_t line);
+
+  std::vector<char> open_;
+  std::array<std::size_t, 2> open_count_{}; // of '*' and '_' in open_
+  bool in_code_ = false;
+  std::vector<Undecided> undecided_; // outermost first
+  // Last byte fed; the start of the source counts as a line start
+  char last_byte_ = '\n';
+  // A delimiter that ended the last feed waits for the byte after it
+  char pending_ = '\0';
+  char pending_before_ = '\0';
+  std::uint64_t line_ = 1;
+  std::uint64_t boundary_line_ = 1;
+};
+
+inline void BlockSplitter::delimiter(char c, char before, char after) {
+  const DelimiterRole role = delimiter_role(before, after);
+  const std::size_t kind = c == '_';
+  if (role.can_close && open_count_[kind] != 0 &&
+      (!role.can_open || open_.back() == c)) {
+    // Closes the innermost open one of its kind, dropping the ones above it
+    while (open_.back() != c) {
+      open_.pop_back();
+      --open_count_[1 - kind];
+    }
+    // The newlines it was open at continue the paragraph
+    while (!undecided_.empty() && undecided_.back().depth >= open_.size())
+      undecided_.pop_back();
+    open_.pop_back();
+    --open_count_[kind];
+  } else if (role.can_open) {
+    open_.push_back(c);
+    ++open_count_[kind];
+  }
+}
+
+// False only when `rest` shows the backtick before it is literal. A failed
+// search ends at a blank line with no backtick before it, so every byte is
+// searched at most once per paragraph.
+inline bool BlockSplitter::code_span_opens(std::string_view rest,
+                                           bool at_end) {
+  for (std::size_t i = rest.find_first_of("`\n"); i != std::string_view::npos;
+       i = rest.find_first_of("`\n", i + 1)) {
+    if (rest[i] == '`')
+      return true;
+    if (i + 1 < rest.size() && rest[i + 1] == '\n')
+      return false;
+  }
+  return !at_end;
+}
+
+// The state just after a boundary
+inline void BlockSplitter::restart(std::uint64_t line) {
+  open_.clear();
+  open_count_ = {};
+  in_code_ = false;
+  undecided_.clear();
+  last_byte_ = '\n';
+  pending_ = '\0';
+  line_ = line;
+}
+
+template <class OnBoundary>
+std::size_t BlockSplitter::feed(std::string_view text,
+                                OnBoundary &&on_boundary, bool at_end) {
+  if (text.empty())
+    return 0;
+  // Undecided newlines of earlier feeds are taken to continue
+  undecided_.clear();
+  if (pending_ != '\0') {
+    delimiter(pending_, pending_before_, text[0]);
+    pending_ = '\0';
+  }
+
+  // Only the bytes that end a TEXT token can change the splitter's state
+  StructuralIndex index(text);
+  std::size_t cut = 0;
+  // False when on_boundary stops the feed
+  auto report = [&](std::size_t at, std::uint64_t line) {
+    cut = at;
+    boundary_line_ = line;
+    if constexpr (std::is_same_v<std::invoke_result_t<OnBoundary &, std::size_t,
+                                                      std::uint64_t>,
+                                 bool>) {
+      if (!on_boundary(at, line)) {
+        restart(line);
+        return false;
+      }
+    } else {
+      on_boundary(at, line);
+    }
+    return true;
+  };
+  // Nothing open at them closes before the blank line or the end
+  auto report_undecided = [&]() {
+    // A stop clears undecided_, so it is indexed rather than iterated
+    for (std::size_t k = 0; k < undecided_.size(); ++k)
+      if (!report(undecided_[k].cut, undecided_[k].line))
+        return false;
+    undecided_.clear();
+    return true;
+  };
+
+  for (std::size_t i = index.next(0); i < text.size(); i = index.next(i + 1)) {
+    const char c = text[i];
+    const char before = i == 0 ? last_byte_ : text[i - 1];
+    if (c == '\n') {
+      ++line_;
+      if (before == '\n') {
+        // Blank line
+        open_.clear();
+        open_count_ = {};
+        in_code_ = false;
+        if (!report_undecided())
+          return cut;
+      }
+      if (in_code_)
+        continue;
+      if (!open_.empty())
+        undecided_.push_back({i + 1, line_, open_.size()});
+      else if (!report(i + 1, line_))
+        return cut;
+      continue;
+    }
+
+    if (in_code_) {
+      if (c == '`')
+        in_code_ = false;
+      continue;
+    }
+
+    if (c == '`') {
+      in_code_ = code_span_opens(text.substr(i + 1), at_end);
+    } else if (i + 1 == text.size() && !at_end) {
+      pending_ = c;
+      pending_before_ = before;
+    } else {
+      delimiter(c, before, i + 1 == text.size() ? '\n' : text[i + 1]);
+    }
+  }
+  if (at_end && !report_undecided())
+    return cut;
+  last_byte_ = text.back();
+  return cut;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "document.hpp"
+#include "io.hpp"
+#include "source.hpp"
+
+class LineIndex;
+
+// Layout of a .termyc file: a parsed Document flattened into fixed-size
+// records that refer to each other by index and to text by offset into one
+// string table, so the file works wherever it is mapped. Multi-byte fields
+// are in the writer's byte order; a file from a machine with the other order
+// is rejected, as is any other version.
+namespace termyc {
+
+inline constexpr char kMagic[8] = {'T', 'E', 'R', 'M', 'Y', 'C', '\r', '\n'};
+// Bump whenever a record below changes
+inline constexpr std::uint32_t kVersion = 1;
+inline constexpr std::uint32_t kByteOrderMark = 0x01020304;
+
+struct Section {
+    std::uint64_t offset; // from the start of the file, 8-byte aligned
+    std::uint64_t count;  // records, or bytes for the string table
+};
+
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t first_line;
+    // The string table starts with the whole source; text folded across
+    // lines by the parser follows it
+    std::uint64_t source_size;
+    Section blocks;
+    Section inlines;
+    Section words;
+    Section strings;
+};
+
+enum class BlockKind : std::uint32_t { Heading, Paragraph };
+// In Document::Inline::node order
+enum class InlineKind : std::uint32_t { Text, Bold, Italic, Code };
+
+struct Block {
+    SourceRange range;
+    BlockKind kind;
+    std::uint32_t level;       // headings
+    std::uint32_t text_offset; // heading text
+    std::uint32_t text_size;
+    std::uint32_t first;       // a paragraph's top-level inlines
+    std::uint32_t count;
+    std::uint32_t first_word;  // a paragraph's words
+    std::uint32_t word_count;
+};
+
+// Text and Code refer to their text, Bold and Italic to their children, which
+// are consecutive records
+struct Inline {
+    SourceRange range;
+    InlineKind kind;
+    std::uint32_t first;
+    std::uint32_t count;
+    std::uint32_t reserved;
+};
+
+struct Word {
+    std::uint32_t text_offset;
+    std::uint32_t text_size;
+    std::uint32_t width;
+    std::uint8_t style; // StyleState::bits()
+    std::uint8_t glue;
+    std::uint8_t first_in_run;
+    std::uint8_t reserved;
+};
+
+} // namespace termyc
+
+// A paragraph's words read in place from a .termyc mapping. Indexing builds
+// the same Document::Word the parser would have made, so the line breakers
+// and the emitter take either.
+class CompiledWords {
+public:
+    CompiledWords(std::span<const termyc::Word> words, const char* strings)
+        : words_(words), strings_(strings) {}
+
+    std::size_t size() const { return words_.size(); }
+    Document::Word operator[](std::size_t i) const {
+        const termyc::Word& w = words_[i];
+        return {std::string_view(strings_ + w.text_offset, w.text_size), w.width,
+                StyleState::from_bits(w.style), w.glue != 0, w.first_in_run != 0};
+    }
+
+private:
+    std::span<const termyc::Word> words_;
+    const char* strings_;
+};
+
+// A .termyc file mapped read-only. Opening checks the header and that every
+// index and offset stays inside the file; after that the records are used
+// where they lie, with no copy and no allocation.
+class CompiledDocument {
+public:
+    static CompiledDocument open(const std::string& path);
+    // Takes over an already opened file; throws if it is not a valid .termyc
+    explicit CompiledDocument(MappedFile file);
+    CompiledDocument(CompiledDocument&&) noexcept;
+    CompiledDocument& operator=(CompiledDocument&&) noexcept;
+    ~CompiledDocument();
+
+    // Whether `bytes` starts like a .termyc file
+    static bool is_compiled(std::string_view bytes);
+
+    std::span<const termyc::Block> blocks() const { return blocks_; }
+    std::span<const termyc::Inline> inlines() const { return inlines_; }
+    std::span<const termyc::Inline> children(const termyc::Inline& node) const {
+        return inlines_.subspan(node.first, node.count);
+    }
+    std::span<const termyc::Inline> children(const termyc::Block& paragraph) const {
+        return inlines_.subspan(paragraph.first, paragraph.count);
+    }
+    CompiledWords words(const termyc::Block& paragraph) const {
+        return {words_.subspan(paragraph.first_word, paragraph.word_count),
+                strings_.data()};
+    }
+    std::string_view text(std::uint32_t offset, std::uint32_t size) const {
+        return strings_.substr(offset, size);
+    }
+    std::string_view source() const { return strings_.substr(0, source_size_); }
+    // Same as Document::span; the line table is built on first use
+    SourceSpan span(SourceRange r) const;
+
+private:
+    MappedFile file_;
+    std::span<const termyc::Block> blocks_;
+    std::span<const termyc::Inline> inlines_;
+    std::span<const termyc::Word> words_;
+    std::string_view strings_;
+    std::uint64_t source_size_ = 0;
+    std::uint64_t first_line_ = 1;
+    mutable std::unique_ptr<LineIndex> lines_;
+};
+
+// Flattens `doc` into the .termyc layout. Throws if the source is too large
+// for the 32-bit offsets.
+std::string compile_document(const Document& doc);
@@ -0,0 +1,20 @@
+#pragma once
+
+// Whether a `*` or `_` can open and/or close a styled run, from the bytes
+// around it. A simplified form of CommonMark's flanking rules: it can open
+// when text follows it and close when text precedes it, so in `*a _b *c d* e_*`
+// the inner `*` nests instead of closing the outer one. The start and end of
+// the source count as whitespace.
+struct DelimiterRole {
+  bool can_open;
+  bool can_close;
+};
+
+constexpr bool is_delimiter_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+constexpr DelimiterRole delimiter_role(char before, char after) {
+  return {!is_delimiter_space(after), !is_delimiter_space(before)};
+}
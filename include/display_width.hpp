@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Terminal column width of UTF-8 text, for all layout decisions. ASCII is
+// one column per byte and is recognised 16 bytes at a time; everything else
+// is decoded and looked up in tables built at compile time from the Unicode
+// East Asian Width (wide/fullwidth = 2) and combining/format (0) ranges.
+// Malformed bytes count as one column each, like the replacement character a
+// terminal draws for them.
+
+// Width of one code point: 0, 1 or 2
+int codepoint_width(char32_t cp);
+
+namespace display_width_detail {
+// Width of `s` from its first non-ASCII byte on
+std::size_t utf8_width(std::string_view s);
+} // namespace display_width_detail
+
+// Length of the leading run of ASCII bytes
+inline std::size_t ascii_prefix(std::string_view s) {
+  const char *p = s.data();
+  std::size_t i = 0;
+  const std::size_t n = s.size();
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    if (int mask = _mm_movemask_epi8(v); mask != 0)
+      return i + static_cast<std::size_t>(__builtin_ctz(mask));
+  }
+#endif
+  for (; i + 8 <= n; i += 8) {
+    std::uint64_t v;
+    std::memcpy(&v, p + i, sizeof v);
+    if (v & 0x8080808080808080ULL)
+      break;
+  }
+  while (i < n && static_cast<unsigned char>(p[i]) < 0x80)
+    ++i;
+  return i;
+}
+
+inline std::size_t display_width(std::string_view s) {
+  const std::size_t ascii = ascii_prefix(s);
+  if (ascii == s.size())
+    return ascii;
+  return ascii + display_width_detail::utf8_width(s.substr(ascii));
+}
@@ -1,68 +1,131 @@
 #pragma once
+#include <cstdint>
 #include <memory>
-#include <string>
+#include <memory_resource>
+#include <span>
+#include <string_view>
 #include <variant>
 #include <vector>
 
 #include "source.hpp"
+#include "style_state.hpp"
 
+class LineIndex;
+
+// All inline nodes and child arrays live in a per-document arena and are
+// released together with the Document. Text is viewed in place wherever the
+// source has it contiguously, so the source buffer must outlive the Document.
 class Document {
 
 public:
   struct Inline {
-    using Ptr = std::shared_ptr<Inline>;
+    using Ptr = const Inline *;
+    using Children = std::span<const Ptr>;
 
     struct Text {
-      std::string text;
+      std::string_view text;
     };
 
     struct Bold {
-      std::vector<Ptr> children;
+      Children children;
     };
 
     struct Italic {
-      std::vector<Ptr> children;
+      Children children;
     };
 
     struct Code {
-      std::string text;
+      std::string_view text;
     };
 
 
     std::variant<Text, Bold, Italic, Code> node;
-    SourceSpan span{};
-
-    Inline(Text t, SourceSpan sp) : node(std::move(t)), span(sp) {}
-    Inline(Bold e, SourceSpan sp) : node(std::move(e)), span(sp) {}
-    Inline(Italic i, SourceSpan sp) : node(std::move(i)), span(sp) {}
-    Inline(Code c, SourceSpan sp) : node(std::move(c)), span(sp) {}
+    SourceRange range{};
 
-    static Ptr make_text(std::string s, SourceSpan sp);
-    static Ptr make_bold(std::vector<Ptr> children, SourceSpan sp);
-    static Ptr make_italic(std::vector<Ptr> children, SourceSpan sp);
-    static Ptr make_code(std::string s, SourceSpan sp);
+    Inline(Text t, SourceRange r) : node(t), range(r) {}
+    Inline(Bold e, SourceRange r) : node(e), range(r) {}
+    Inline(Italic i, SourceRange r) : node(i), range(r) {}
+    Inline(Code c, SourceRange r) : node(c), range(r) {}
   };
 
 
 
   using InlinePtr = Inline::Ptr;
+
+  // A paragraph's text flattened for layout: whitespace-separated pieces of
+  // its Text and Code nodes with their style and display width. `glue`
+  // words (punctuation only) attach to the previous word without a space.
+  struct Word {
+    std::string_view text;
+    std::uint32_t width = 0;
+    StyleState style;
+    bool glue = false;
+    bool first_in_run = false; // first word of its Text or Code node
+  };
+  using Words = std::span<const Word>;
+
   struct Heading {
     int level = 0;
-    SourceSpan span{};
-    std::string text;
+    SourceRange range{};
+    std::string_view text;
   };
 
   struct Paragraph {
-    SourceSpan span{};
-    std::vector<InlinePtr> inlines;
+    SourceRange range{};
+    Inline::Children inlines;
+    Words words;
   };
 
   using Block = std::variant<Heading, Paragraph>;
 
+  Document();
+  Document(Document &&) noexcept;
+  Document &operator=(Document &&) noexcept;
+  ~Document();
+
+  // Drops every block and node, keeping the block list's capacity and enough
+  // arena for what was used, so parsing a similar document into it again
+  // allocates nothing. Views into the old source must not be used afterwards.
+  void reset();
+
   const std::vector<Block>& blocks() const { return blocks_; }
+  // Source text the document was parsed from; its views point into it
+  std::string_view source() const { return source_; }
+  std::uint64_t first_line() const { return first_line_; }
+  void set_source(std::string_view s, std::uint64_t first_line = 1) {
+    source_ = s;
+    first_line_ = first_line;
+  }
+  // Line and column of a node's range. The line table is only built the
+  // first time a position is asked for, e.g. for a diagnostic.
+  SourceSpan span(SourceRange r) const;
   void add(Block b) { blocks_.push_back(std::move(b)); }
   static Document parse(std::istream &in);
 
+  InlinePtr make_text(std::string_view s, SourceRange r);
+  // `children` must already be arena-owned, i.e. come from make_children
+  InlinePtr make_bold(Inline::Children children, SourceRange r);
+  InlinePtr make_italic(Inline::Children children, SourceRange r);
+  InlinePtr make_code(std::string_view s, SourceRange r);
+
+  // Copies into the arena, for nodes assembled in caller-owned scratch
+  Inline::Children make_children(std::span<const InlinePtr> nodes);
+  std::string_view intern(std::string_view s);
+  // Flattens a paragraph's inline tree into arena-owned words, once, so the
+  // emitter only makes a straight pass over them
+  Words make_words(Inline::Children inlines);
+
 private:
+  template <class Node> InlinePtr make(Node n, SourceRange r);
+  void *allocate(std::size_t bytes, std::size_t align);
+
+  std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+  // Set up by reset(): the arena's first buffer, sized from earlier use
+  std::unique_ptr<std::byte[]> arena_buffer_;
+  std::size_t arena_capacity_ = 0;
+  std::size_t arena_used_ = 0; // upper bound, including alignment
   std::vector<Block> blocks_;
+  std::string_view source_;
+  std::uint64_t first_line_ = 1;
+  mutable std::unique_ptr<LineIndex> lines_;
 };
@@ -1,54 +1,74 @@
 #pragma once
 #include "document.hpp"
+#include "output_buffer.hpp"
+#include "style_state.hpp"
+#include <iosfwd>
 #include <string>
+#include <string_view>
+
+class CompiledDocument;
+
+enum class WrapMode { Greedy, Optimal };
+
+// Ansi draws Unicode boxes and SGR styles for a terminal, Plain keeps the
+// same layout with ASCII boxes and no escapes, Html writes <hN> and <p>
+// elements with inline tags
+enum class OutputFormat { Ansi, Plain, Html };
 
-struct StyleState {
-  bool bold = false;
-  bool italic = false;
-  bool code = false;
-
-  auto operator<=>(const StyleState &) const = default;
-
-  std::string to_ansi() const {
-    if (code)
-      return "\x1b[7m";
-    if (bold && italic)
-      return "\x1b[1;3m";
-    if (bold)
-      return "\x1b[1m";
-    if (italic)
-      return "\x1b[3m";
-    return "\x1b[0m";
-  }
-};
 struct Style {
   std::size_t width = 80;
   std::size_t paragraph_indent = 0;
+  WrapMode wrap = WrapMode::Greedy;
+  OutputFormat format = OutputFormat::Ansi;
+  // Reset styles before every line break and reopen them after it, so each
+  // line is correct on its own, e.g. when a pager shows it out of context
+  bool close_styles_per_line = false;
 };
 
-struct Run {
-  std::string text;
-  StyleState style;
-  bool glue_left;
+// Output policies for BasicEmitter, defined in emitter.cpp
+struct AnsiBackend;
+struct PlainBackend;
+struct HtmlBackend;
+
+// Renders a document through one backend, resolved at compile time so the
+// per-word loop has no format checks. Ignores Style::format.
+template <class Backend> class BasicEmitter {
+public:
+  explicit BasicEmitter(const Style &s) : style_(s) {}
+  void render(OutputBuffer &out, const Document &doc) const;
+  // Same output as rendering the Document it was compiled from
+  void render(OutputBuffer &out, const CompiledDocument &doc) const;
+
+private:
+  void box_heading(OutputBuffer &out, std::string_view s, int level,
+                   std::size_t pad = 1) const;
+  template <class Words>
+  void wrap_paragraph(OutputBuffer &out, Words words, std::size_t width,
+                      std::size_t indent = 0) const;
+  Style style_;
 };
 
+extern template class BasicEmitter<AnsiBackend>;
+extern template class BasicEmitter<PlainBackend>;
+extern template class BasicEmitter<HtmlBackend>;
+
+using AnsiEmitter = BasicEmitter<AnsiBackend>;
+using PlainEmitter = BasicEmitter<PlainBackend>;
+using HtmlEmitter = BasicEmitter<HtmlBackend>;
+
+// Picks the backend from Style::format once per render
 class Emitter {
 public:
   explicit Emitter(Style s = {});
   const Style &getStyle() const { return style_; }
+  // Same settings at another width. A Document's words are measured when it
+  // is parsed, so rendering it again this way only redoes line breaking.
+  Emitter with_width(std::size_t width) const;
+  void render(OutputBuffer &out, const Document &doc) const;
+  void render(OutputBuffer &out, const CompiledDocument &doc) const;
   void render(std::ostream &out, const Document &doc) const;
   std::string render_to_string(const Document &doc) const;
 
 private:
-  std::string box_heading(std::string_view s, int level,
-                          std::size_t pad = 1) const;
   Style style_;
-  void wrap_paragraph(std::ostream &out,
-                      const std::vector<Document::InlinePtr> &inlines,
-                      std::size_t width, std::size_t indent = 0) const;
-  void skip_whitespace(std::size_t &i, std::string_view text) const;
-  void skip_non_whitespace(std::size_t &i, std::string_view text) const;
-  void flatten_runs(const std::vector<Document::InlinePtr> &inlines,
-                    StyleState current_style, std::vector<Run> &out) const;
-  bool is_punctuation(std::string_view s) const;
-};
\ No newline at end of file
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Fast non-cryptographic 64-bit hash for content addressing rendered blocks.
+// Consumes 16 bytes per step with a 64x64->128 multiply-fold (wyhash style).
+namespace hash_detail {
+
+constexpr std::uint64_t kP0 = 0xa0761d6478bd642fULL;
+constexpr std::uint64_t kP1 = 0xe7037ed1a0b428dbULL;
+constexpr std::uint64_t kP2 = 0x8ebc6af09c88c6e3ULL;
+
+inline std::uint64_t mix(std::uint64_t a, std::uint64_t b) {
+  __uint128_t r = static_cast<__uint128_t>(a) * b;
+  return static_cast<std::uint64_t>(r) ^ static_cast<std::uint64_t>(r >> 64);
+}
+
+inline std::uint64_t load64(const char *p) {
+  std::uint64_t v;
+  std::memcpy(&v, p, sizeof v);
+  return v;
+}
+
+} // namespace hash_detail
+
+inline std::uint64_t hash_bytes(std::string_view s, std::uint64_t seed = 0) {
+  using namespace hash_detail;
+  const char *p = s.data();
+  std::size_t n = s.size();
+  std::uint64_t h = mix(seed ^ kP0, n ^ kP1);
+
+  for (; n >= 16; n -= 16, p += 16)
+    h = mix(load64(p) ^ kP1, load64(p + 8) ^ h);
+
+  std::uint64_t a = 0;
+  std::uint64_t b = 0;
+  if (n > 8) {
+    a = load64(p);
+    std::memcpy(&b, p + 8, n - 8);
+  } else {
+    std::memcpy(&a, p, n);
+  }
+  h = mix(a ^ kP2 ^ n, b ^ h);
+  return mix(h, kP0 ^ s.size());
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RenderCache;
+
+struct HeadingEntry {
+    std::uint64_t offset; // of the line the heading starts on
+    std::uint64_t line;
+    int level;
+    std::string title; // the heading's text without its marks and outer spaces
+};
+
+// A heading and everything under it: the bytes up to the next heading of the
+// same or a higher level (as many '=' or fewer), or to the end
+struct SectionRange {
+    std::uint64_t begin;
+    std::uint64_t end;
+    std::uint64_t first_line;
+};
+
+// Headings are the lines that start with '=' where the parser is at block
+// level, which a BlockSplitter finds from the structural bytes alone, so
+// neither function lexes or parses any text.
+std::vector<HeadingEntry> index_headings(std::string_view source);
+
+// Stops scanning where the section ends, so a section near the start of a
+// large file costs only the bytes up to its end
+std::optional<SectionRange> find_section(std::string_view source, std::string_view title);
+std::optional<SectionRange> find_section(const std::vector<HeadingEntry>& headings,
+                                         std::uint64_t source_size, std::string_view title);
+
+// index_headings, kept in `cache` under the file's path, size, mtime and
+// inode, so later runs on the same unchanged file skip the scan
+std::vector<HeadingEntry> cached_headings(const std::string& path, std::string_view source,
+                                          RenderCache& cache);
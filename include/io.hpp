@@ -4,3 +4,29 @@
 
 std::string read_file(const std::string& path);
 void write_file(const std::string& path, std::string_view contents);
+
+// Read-only contents of a file. Regular files are memory-mapped, so the lexer
+// reads straight from the page cache; pipes, terminals and other non-regular
+// files (and "-" for stdin) fall back to reading into an owned buffer.
+class MappedFile {
+public:
+    static MappedFile open(const std::string& path);
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::string_view view() const { return view_; }
+    bool mapped() const { return map_ != nullptr; }
+
+private:
+    MappedFile() = default;
+    void release() noexcept;
+
+    void* map_ = nullptr;
+    std::size_t map_size_ = 0;
+    std::string owned_;
+    std::string_view view_;
+};
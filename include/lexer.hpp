@@ -1,22 +1,26 @@
 #pragma once
 
-#include <string>
-#include <vector>
+#include <cstdint>
+#include <string_view>
+#include "structural_index.hpp"
 #include "token.hpp"
+#include "token_buffer.hpp"
 #include "token_type.hpp"
 
 class Lexer {
 public:
-    explicit Lexer(std::string& source);
+    explicit Lexer(std::string_view source, std::uint64_t first_line = 1);
 
+    // Scans and returns the next token; at the end of the source, an empty
+    // EOF token anchored there, as often as it is asked for.
     Token next();
     char peek();
-    std::vector<Token> scan_tokens();
-    void addToken(TokenType type);
     void lexToken();
     void heading();
-    std::vector<Token> lexTokens();
-    const std::string& getSource() const { return source_; }
+    // Lexes the rest of the source into one buffer
+    TokenBuffer lexTokens();
+    std::string_view getSource() const { return source_; }
+    std::uint64_t firstLine() const { return first_line_; }
 
 private:
     char advance();
@@ -25,12 +29,13 @@ private:
     Token ident_or_text();
     Token punctuation();
     bool isAtEnd();
-    const std::string& source_;
+    std::string_view source_;
+    StructuralIndex index_;
+    void addToken(TokenType type) { type_ = type; }
+    bool atLineStart() const;
+    std::uint64_t first_line_;
     std::size_t start = 0;
     std::size_t current = 0;
-    SourcePos start_pos{1, 1};
-    SourcePos cur_pos{1, 1};
-    std::size_t line = 1;
-    std::vector<Token> tokens;
-    
+    TokenType type_ = TokenType::EOF_;
+
 };
\ No newline at end of file
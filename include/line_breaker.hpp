@@ -0,0 +1,34 @@
+#pragma once
+#include "document.hpp"
+#include <cstddef>
+#include <span>
+#include <vector>
+
+class CompiledWords;
+
+// Line breaking for wrap_paragraph. Both fill `breaks` with the indices of
+// the words that start a new line, in increasing order; the first line always
+// starts at word 0 and is not listed. Lines begin with `indent` columns.
+// `words` is a Document::Words or the CompiledWords of a .termyc paragraph.
+
+// First fit: a word goes on the current line whenever it fits.
+template <class Words>
+void greedy_breaks(Words words, std::size_t width, std::size_t indent,
+                   std::vector<std::size_t> &breaks);
+
+// Minimum raggedness: minimises the sum of squared trailing space over all
+// lines but the last. Overflowing the width and starting a line with a glue
+// word are heavily penalised, so they only happen when unavoidable. Runs in
+// O(n) using SMAWK on the (Monge) line cost matrix.
+template <class Words>
+void optimal_breaks(Words words, std::size_t width, std::size_t indent,
+                    std::vector<std::size_t> &breaks);
+
+extern template void greedy_breaks(Document::Words, std::size_t, std::size_t,
+                                   std::vector<std::size_t> &);
+extern template void greedy_breaks(CompiledWords, std::size_t, std::size_t,
+                                   std::vector<std::size_t> &);
+extern template void optimal_breaks(Document::Words, std::size_t, std::size_t,
+                                    std::vector<std::size_t> &);
+extern template void optimal_breaks(CompiledWords, std::size_t, std::size_t,
+                                    std::vector<std::size_t> &);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "source.hpp"
+
+// Maps byte offsets to line and column (both 1-based, columns in bytes) by
+// binary search over the offsets of the source's newlines.
+class LineIndex {
+public:
+    explicit LineIndex(std::string_view source, std::uint64_t first_line = 1);
+
+    SourcePos position(std::uint64_t offset) const;
+
+private:
+    std::vector<std::uint64_t> newlines_;
+    std::uint64_t first_line_;
+};
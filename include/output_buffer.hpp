@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Contiguous byte sink the emitter appends to. Bound to a file descriptor it
+// hands full buffers to write(2) in large batches; unbound it simply grows
+// and its contents are taken with str()/take().
+class OutputBuffer {
+public:
+    static constexpr std::size_t kDefaultCapacity = 256 * 1024;
+
+    OutputBuffer() = default;
+    explicit OutputBuffer(int fd, std::size_t capacity = kDefaultCapacity);
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+    // Flushes whatever is left, ignoring errors; call flush() to see them
+    ~OutputBuffer();
+
+    void append(std::string_view s) {
+        if (fd_ >= 0 && buf_.size() + s.size() > capacity_) {
+            spill(s);
+            return;
+        }
+        buf_.append(s);
+    }
+
+    void append(char c) {
+        if (fd_ >= 0 && buf_.size() == capacity_) flush();
+        buf_.push_back(c);
+    }
+
+    void fill(char c, std::size_t n) {
+        if (fd_ >= 0 && buf_.size() + n > capacity_) flush();
+        buf_.append(n, c);
+    }
+
+    void reserve(std::size_t n) { buf_.reserve(n); }
+    std::size_t size() const { return buf_.size(); }
+
+    // Writes buffered bytes to the descriptor; no-op when unbound
+    void flush();
+
+    const std::string& str() const { return buf_; }
+    std::string take() { return std::move(buf_); }
+    void clear() { buf_.clear(); }
+
+private:
+    void spill(std::string_view s);
+    void write_all(std::string_view s);
+
+    int fd_ = -1;
+    std::size_t capacity_ = 0;
+    std::string buf_;
+};
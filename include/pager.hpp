@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "block_splitter.hpp"
+#include "emitter.hpp"
+
+class OutputBuffer;
+
+// A source cut into pieces of whole blocks that are rendered only when they
+// are asked for. Pieces are found by running a BlockSplitter ahead only as
+// far as needed, and the renderings of the most recently used ones are kept,
+// so showing the end of a huge document formats just the last few pieces.
+class PagedDocument {
+public:
+    // A piece ends at the first block boundary after this many bytes
+    static constexpr std::size_t kPieceBytes = 16 * 1024;
+    static constexpr std::size_t kCachedPieces = 256;
+
+    // Finds the first piece; there always is one, if only an empty one
+    PagedDocument(std::string_view source, const Emitter& emitter)
+        : source_(source), emitter_(emitter) {
+        scan();
+    }
+
+    // Whether piece i exists, scanning further into the source if needed
+    bool has(std::size_t i);
+    // Index of the last piece; scans the rest of the source
+    std::size_t last();
+    // Rendered lines of piece i, which has() must have confirmed, without
+    // their newlines. They stay valid
+    // while fewer than kCachedPieces other pieces are rendered.
+    const std::vector<std::string_view>& lines(std::size_t i);
+    // Where piece i starts in the source
+    std::uint64_t offset(std::size_t i) const { return pieces_[i].begin; }
+    std::size_t source_size() const { return source_.size(); }
+
+    // Renders with `emitter` from now on, e.g. at a new width
+    void set_emitter(const Emitter& emitter);
+
+private:
+    struct Piece {
+        std::uint64_t begin;
+        std::uint64_t end;
+        std::uint64_t first_line;
+    };
+    struct Rendered {
+        std::size_t piece;
+        std::string text;
+        std::vector<std::string_view> lines;
+    };
+    bool scanned_all() const;
+    void scan();
+
+    std::string_view source_;
+    Emitter emitter_;
+    BlockSplitter splitter_;
+    std::vector<Piece> pieces_;
+    std::uint64_t scanned_ = 0;
+    std::uint64_t piece_begin_ = 0; // of the piece still being scanned
+    std::uint64_t piece_line_ = 1;
+    std::list<Rendered> cache_; // most recently used first
+    std::unordered_map<std::size_t, std::list<Rendered>::iterator> by_piece_;
+};
+
+// Shows `source` on the terminal one screen at a time, reading keys from
+// /dev/tty: j/k or arrows scroll a line, space/b or PgDn/PgUp a page, g/G or
+// Home/End jump to either end, q quits. With `fit_terminal` the text is
+// wrapped at the terminal's width and re-flowed when it is resized.
+void page_source(std::string_view source, std::string_view title, const Emitter& emitter,
+                 OutputBuffer& out, bool fit_terminal);
@@ -1,29 +1,94 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "block_splitter.hpp"
 #include "document.hpp"
 #include "text_accumulator.hpp"
 #include "token.hpp"
+#include "token_buffer.hpp"
+
+class Lexer;
+
+// Pulls tokens on demand, either straight from a Lexer (lexing and parsing
+// interleave and no token list is ever built) or from a lexed TokenBuffer.
+// Either must outlive the Parser.
 class Parser {
 public:
-  Parser(std::vector<Token> tokens);
+  explicit Parser(Lexer &lexer);
+  explicit Parser(const TokenBuffer &tokens);
   Document parse();
+  // Parses into `doc`, which must be empty, e.g. just reset(), so that its
+  // capacity is reused
+  void parse(Document &doc);
 
 private:
-  const std::vector<Token> tokens_;
+  Lexer *lexer_ = nullptr;
+  const TokenBuffer *buffer_ = nullptr;
+  Document *doc_ = nullptr;
+
+  // The parser looks at most one token behind and one ahead of `current`,
+  // so the tokens it can still see fit in a ring of four. The current token
+  // is always in the ring.
+  static constexpr std::size_t kWindow = 4;
+  std::array<Token, kWindow> window_;
+  std::size_t fetched_ = 0; // tokens pulled so far
+  void fetch();
+
+  // One piece of a paragraph as scanned: literal text (TEXT), a folded
+  // newline (NEWLINE), a `*`/`_` delimiter (STAR, UNDERSCORE) or a whole code
+  // span (BACKTICK). A delimiter that never gets a partner is literal text.
+  struct InlineItem {
+    static constexpr std::uint32_t kUnmatched = UINT32_MAX;
+    TokenType type;
+    std::uint32_t match = kUnmatched;
+    std::string_view text;
+    SourceRange range;
+  };
+
+  // A matched opener whose closer has not been reached yet
+  struct OpenInline {
+    std::size_t children; // where its children start in Scratch::inlines
+    std::uint64_t begin;
+  };
+
+  // Working memory that keeps its capacity from one parse to the next. It is
+  // per thread, so pooled workers reuse theirs across documents.
+  struct Scratch {
+    std::vector<InlineItem> items;
+    std::vector<std::uint32_t> openers; // unmatched delimiters, innermost last
+    // Newlines `splitter` found to end their paragraph, up to
+    // Parser::decided_until_
+    BlockSplitter splitter;
+    std::vector<std::uint64_t> breaks;
+    std::vector<OpenInline> open;
+    // Children of every open inline, stacked; each pops its own
+    std::vector<Document::InlinePtr> inlines;
+    TextAccumulator text;
+  };
+  static Scratch &threadScratch();
+  Scratch &scratch_ = threadScratch();
   void skipBlanks();
   Document::Heading heading();
   Document::Paragraph paragraph();
-  int current = 0;
+  std::size_t current = 0;
   bool check(TokenType type);
   bool match(TokenType type);
   const Token &peek() const;
+  const Token &lookahead();
   const Token &previous() const;
   bool isAtEnd();
   const Token &advance();
-  bool handleNewlineInParagraph(TextAccumulator &text, bool &consumed_any);
 
-  std::vector<Document::InlinePtr> parseInlines(TokenType endToken = TokenType::NEWLINE);
-  Document::InlinePtr parseBold();
-  Document::InlinePtr parseItalic();
-  Document::InlinePtr parseCode();
+  Document::Inline::Children parseInlines();
+  void scanInlines();
+  void matchDelimiter(std::size_t (&open)[2]);
+  bool codeSpanCloses(std::uint64_t offset) const;
+  bool newlineEndsParagraph(std::uint64_t offset, std::uint64_t paragraph);
+  std::uint64_t decided_until_ = 0;
+  std::size_t next_break_ = 0;
+  InlineItem parseCode();
+  Document::Inline::Children buildInlines();
   Document::Block block();
   
 };
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Emitter;
+class OutputBuffer;
+
+// Lexes, parses and renders `source` in one go. `first_line` is the line the
+// source starts on when it is a piece of a larger input.
+void render_source(OutputBuffer &out, std::string_view source,
+                   const Emitter &emitter, std::uint64_t first_line = 1);
+
+// Reads `fd` in chunks and renders every complete block as soon as it has
+// arrived, flushing `out` after each chunk. Only the unfinished tail block is
+// kept between reads.
+void render_stream(int fd, OutputBuffer &out, const Emitter &emitter);
+
+// Cuts `source` into chunks at block boundaries and lexes, parses and renders
+// them on `jobs` worker threads. Output is written in source order and is
+// byte-identical to render_source on the whole input.
+void render_parallel(OutputBuffer &out, std::string_view source,
+                     const Emitter &emitter, std::size_t jobs);
+
+// Lexes and parses `source` once and renders it at each of `widths`, in
+// order; every extra width only costs line breaking and output.
+std::vector<std::string> render_widths(std::string_view source,
+                                       const Emitter &emitter,
+                                       std::span<const std::size_t> widths);
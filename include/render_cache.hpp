@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+class Emitter;
+class OutputBuffer;
+
+// Content-addressed on-disk store of rendered blocks, shareable between
+// concurrent terminyl processes. Entries are written to a temporary file and
+// renamed into place, so readers only ever see complete entries. Hits refresh
+// the entry's mtime; once the directory grows past its size budget the least
+// recently used entries are removed. Safe to share between threads.
+class RenderCache {
+public:
+    struct Key {
+        std::uint64_t hi;
+        std::uint64_t lo;
+    };
+
+    static constexpr std::uint64_t kDefaultMaxBytes = 256ull << 20;
+
+    explicit RenderCache(std::filesystem::path dir,
+                         std::uint64_t max_bytes = kDefaultMaxBytes);
+    // Evicts if this process stored anything
+    ~RenderCache();
+
+    // Key of a block's source under the given emitter settings
+    static Key key_for(std::string_view source, const Emitter& emitter);
+
+    std::optional<std::string> load(const Key& key);
+    void store(const Key& key, std::string_view rendered);
+
+    // Removes least recently used entries until the cache fits its budget
+    void evict();
+
+    std::size_t hits() const { return hits_; }
+    std::size_t misses() const { return misses_; }
+
+private:
+    std::filesystem::path path_for(const Key& key) const;
+
+    std::filesystem::path dir_;
+    std::uint64_t max_bytes_;
+    std::atomic<std::uint64_t> stored_bytes_{0};
+    std::atomic<std::size_t> hits_{0};
+    std::atomic<std::size_t> misses_{0};
+};
+
+// Renders `source` block by block, taking blocks from `cache` when present and
+// storing the ones it had to render. Output is identical to render_source.
+void render_cached(OutputBuffer& out, std::string_view source,
+                   const Emitter& emitter, RenderCache& cache);
@@ -0,0 +1,34 @@
+#pragma once
+#include <string_view>
+
+#include "document.hpp"
+#include "emitter.hpp"
+#include "output_buffer.hpp"
+
+// Renders snippet after snippet for a long-running embedder. The document's
+// block list and arena, the parser's and emitter's scratch and the context's
+// own output buffer all keep their capacity between calls, so once a context
+// has seen its largest input, rendering allocates nothing. One context per
+// thread: the parser and emitter scratch is per thread already.
+class RenderContext {
+public:
+    explicit RenderContext(Style style = {}) : emitter_(style) {}
+
+    // Appends the rendering of `source` to `out`. `source` only has to live
+    // for the duration of the call.
+    void render(std::string_view source, OutputBuffer& out);
+
+    // Renders into the context's own buffer, replacing the previous result.
+    // The view is valid until the next render() or reset().
+    std::string_view render(std::string_view source);
+
+    // Forgets the last document and output; capacity is kept
+    void reset();
+
+    const Emitter& emitter() const { return emitter_; }
+
+private:
+    Emitter emitter_;
+    Document doc_;
+    OutputBuffer out_;
+};
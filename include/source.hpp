@@ -2,11 +2,17 @@
 
 #include <cstdint>
 struct SourcePos {
-    std::uint32_t line = 1;
-    std::uint32_t column = 1;
+    std::uint64_t line = 1;
+    std::uint64_t column = 1;
 };
 
 struct SourceSpan {
     SourcePos start;
     SourcePos end;
-};
\ No newline at end of file
+};
+
+// Byte offsets into the parsed source; resolved to a SourceSpan on demand
+struct SourceRange {
+    std::uint64_t begin = 0;
+    std::uint64_t end = 0;
+};
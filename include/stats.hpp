@@ -0,0 +1,84 @@
+#pragma once
+
+// Run statistics for --stats. Everything here is only compiled with
+// -DTERMINYL_STATS=ON; otherwise the TERMINYL_STATS_* hooks expand to nothing
+// and their arguments are never evaluated.
+
+#ifdef TERMINYL_STATS
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+
+#include "token_type.hpp"
+
+class Document;
+class TokenBuffer;
+
+namespace stats {
+
+enum class Stage { read, lex, parse, emit };
+inline constexpr std::size_t kStages = 4;
+inline constexpr std::size_t kTokenTypes =
+    static_cast<std::size_t>(TokenType::EOF_) + 1;
+// In Document::Inline::node order
+inline constexpr std::size_t kInlineKinds = 4;
+
+using Counter = std::atomic<std::uint64_t>;
+
+// Summed over all threads, so stage times of a parallel run can add up to
+// more than its wall time
+struct Counters {
+  std::array<Counter, kStages> wall_ns{};
+  std::array<Counter, kStages> cpu_ns{};
+  std::array<Counter, kTokenTypes> tokens{};
+  std::array<Counter, kInlineKinds> inlines{};
+  Counter headings{0};
+  Counter paragraphs{0};
+  Counter bytes_in{0};
+  Counter bytes_out{0};
+  Counter escape_bytes{0};
+};
+
+Counters &counters();
+
+// Adds the wall and thread CPU time of its lifetime to `stage`
+class StageTimer {
+public:
+  explicit StageTimer(Stage stage);
+  ~StageTimer();
+  StageTimer(const StageTimer &) = delete;
+  StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+  Stage stage_;
+  std::uint64_t wall_start_;
+  std::uint64_t cpu_start_;
+};
+
+void count_tokens(const TokenBuffer &tokens);
+void count_document(const Document &doc);
+
+// Human-readable table, or a single JSON object when `json` is set
+void report(std::ostream &out, bool json);
+
+} // namespace stats
+
+#define TERMINYL_STATS_CONCAT_(a, b) a##b
+#define TERMINYL_STATS_NAME_(line) TERMINYL_STATS_CONCAT_(stats_timer_, line)
+#define TERMINYL_STATS_STAGE(stage)                                            \
+  ::stats::StageTimer TERMINYL_STATS_NAME_(__LINE__)(::stats::Stage::stage)
+#define TERMINYL_STATS_ADD(counter, n)                                         \
+  ::stats::counters().counter.fetch_add((n), std::memory_order_relaxed)
+#define TERMINYL_STATS_TOKENS(tokens) ::stats::count_tokens(tokens)
+#define TERMINYL_STATS_DOCUMENT(doc) ::stats::count_document(doc)
+
+#else
+
+#define TERMINYL_STATS_STAGE(stage) static_cast<void>(0)
+#define TERMINYL_STATS_ADD(counter, n) static_cast<void>(0)
+#define TERMINYL_STATS_TOKENS(tokens) static_cast<void>(0)
+#define TERMINYL_STATS_DOCUMENT(doc) static_cast<void>(0)
+
+#endif
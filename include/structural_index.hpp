@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Finds the bytes that end a TEXT token ('\n', '*', '_', '`') so the lexer
+// can jump over prose instead of walking it byte by byte. The source is
+// classified 64 bytes at a time into a bitmask with the widest SIMD kernel
+// the CPU supports (AVX2, SSE2, or scalar), picked once at startup.
+//
+// The other single-character tokens only matter where a token starts, which
+// lexToken already handles, so they are deliberately not indexed.
+class StructuralIndex {
+public:
+  explicit StructuralIndex(std::string_view source) : source_(source) {}
+
+  // Offset of the first structural byte at or after `pos`, or the source size
+  // if there is none.
+  std::size_t next(std::size_t pos);
+
+  // Name of the kernel in use: "avx2", "sse2" or "scalar".
+  static const char *kernel_name();
+
+private:
+  void load(std::size_t block);
+
+  std::string_view source_;
+  std::size_t block_ = static_cast<std::size_t>(-1);
+  std::uint64_t mask_ = 0;
+};
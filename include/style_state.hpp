@@ -0,0 +1,46 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+// Character attributes in effect for a piece of paragraph text. Each one is
+// a single SGR attribute with its own "off" code (code spans are drawn in
+// reverse video), so switching between two states never needs a full reset.
+// Colours would fit the same scheme as further parameters of the one
+// sequence a transition emits.
+struct StyleState {
+  bool bold = false;
+  bool italic = false;
+  bool code = false;
+  bool underline = false;
+
+  auto operator<=>(const StyleState &) const = default;
+  // Whole-word compare; the emitter checks this for every word
+  friend constexpr bool operator==(StyleState a, StyleState b) {
+    return std::bit_cast<std::uint32_t>(a) == std::bit_cast<std::uint32_t>(b);
+  }
+
+  static constexpr unsigned kCombinations = 16;
+
+  constexpr unsigned bits() const {
+    return unsigned{bold} | unsigned{italic} << 1 | unsigned{code} << 2 |
+           unsigned{underline} << 3;
+  }
+
+  static constexpr StyleState from_bits(unsigned b) {
+    return {(b & 1) != 0, (b & 2) != 0, (b & 4) != 0, (b & 8) != 0};
+  }
+
+  // The attributes set on both sides
+  constexpr StyleState common(StyleState o) const {
+    return from_bits(bits() & o.bits());
+  }
+};
+
+// Shortest escape sequence that changes the terminal from `from` to `to`;
+// empty when they are equal. Looked up in a table built at compile time.
+std::string_view sgr_transition(StyleState from, StyleState to);
+
+// Closing and opening tags (<strong>, <em>, <code>, <u>) that take properly
+// nested HTML from `from` to `to`; empty when they are equal.
+std::string_view html_transition(StyleState from, StyleState to);
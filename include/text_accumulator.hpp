@@ -1,39 +1,69 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include "document.hpp"
 
+// Collects consecutive text tokens into one Text node. Tokens are adjacent in
+// the source, so the text stays a view into it until a newline has to be
+// folded into a space; only then is it copied into scratch and interned.
 class TextAccumulator {
 private:
-    std::string text_;
-    SourcePos start_;
+    std::string_view view_;
+    std::string folded_;
+    bool folding_ = false;
+    std::uint64_t start_ = 0;
     bool has_start_ = false;
 
+    void startFolding() {
+        folded_.assign(view_);
+        folding_ = true;
+    }
+
 public:
-    void append(std::string_view lexeme, SourcePos pos) {
+    void append(std::string_view lexeme, std::uint64_t offset) {
         if (!has_start_) {
-            start_ = pos;
+            start_ = offset;
             has_start_ = true;
         }
-        text_ += lexeme;
+        if (folding_) {
+            folded_ += lexeme;
+        } else if (view_.empty()) {
+            view_ = lexeme;
+        } else if (view_.data() + view_.size() == lexeme.data()) {
+            view_ = std::string_view(view_.data(), view_.size() + lexeme.size());
+        } else {
+            startFolding();
+            folded_ += lexeme;
+        }
     }
     
     void appendSpace() {
-        if (!text_.empty() && text_.back() != ' ') {
-            text_.push_back(' ');
+        if (isEmpty())
+            return;
+        if (!folding_) {
+            if (view_.back() == ' ')
+                return;
+            startFolding();
+        }
+        if (folded_.back() != ' ') {
+            folded_.push_back(' ');
         }
     }
     
-    bool isEmpty() const { return text_.empty(); }
+    bool isEmpty() const { return folding_ ? folded_.empty() : view_.empty(); }
     
     bool hasStart() const { return has_start_; }
     
-    SourcePos startPos() const { return start_; }
+    std::uint64_t startOffset() const { return start_; }
     
-    Document::Inline::Ptr flush(SourcePos end_pos) {
-        SourceSpan span{start_, end_pos};
-        auto result = Document::Inline::make_text(std::move(text_), span);
-        text_.clear();
+    Document::InlinePtr flush(Document &doc, std::uint64_t end) {
+        SourceRange range{start_, end};
+        auto result = doc.make_text(folding_ ? doc.intern(folded_) : view_, range);
+        view_ = {};
+        folded_.clear();
+        folding_ = false;
         has_start_ = false;
         return result;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing pool. Every worker owns a deque: it takes its own
+// newest task first and, when that runs dry, steals the oldest task from the
+// others. Tasks submitted from outside are spread round-robin.
+class ThreadPool {
+public:
+    explicit ThreadPool(std::size_t workers = std::thread::hardware_concurrency());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task has run. Rethrows the first exception
+    // a task let escape.
+    void wait();
+
+    std::size_t size() const { return threads_.size(); }
+
+    // Index of the calling worker in [0, size()), or size() off the pool.
+    std::size_t worker_index() const;
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // Stops the workers once the queues are drained and joins them
+    void shutdown();
+    void run(std::size_t self);
+    bool try_take(std::size_t self, std::function<void()> &task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex state_m_;
+    std::condition_variable work_cv_;
+    std::condition_variable idle_cv_;
+    std::size_t queued_ = 0;
+    std::size_t unfinished_ = 0;
+    bool stop_ = false;
+    std::exception_ptr error_;
+
+    std::atomic<std::size_t> next_queue_{0};
+};
@@ -1,17 +1,23 @@
 #pragma once
 
+#include <cstdint>
 #include <string_view>
-#include "source.hpp"
 #include "token_type.hpp"
 
+// A view of one token, as returned by Lexer::next or read from a
+// TokenBuffer; cheap to copy.
 class Token {
 public:
-    Token(TokenType type, std::string_view lexeme, SourceSpan span);
+    Token() = default;
+    Token(TokenType type, std::string_view lexeme, std::uint64_t offset)
+        : type_(type), lexeme_(lexeme), offset_(offset) {}
     TokenType getType() const { return type_; }
     std::string_view getLexeme() const { return lexeme_; }
-    const SourceSpan& span() const noexcept { return span_; }
+    // Byte offsets of the lexeme in the lexed source
+    std::uint64_t offset() const noexcept { return offset_; }
+    std::uint64_t end() const noexcept { return offset_ + lexeme_.size(); }
 private:
-    TokenType type_;
+    TokenType type_ = TokenType::EOF_;
     std::string_view lexeme_;
-    SourceSpan span_;
+    std::uint64_t offset_ = 0;
 };
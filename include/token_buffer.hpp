@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "token.hpp"
+#include "token_type.hpp"
+
+// The lexer's output as parallel arrays: a one-byte type and the start offset
+// of every token, 9 bytes per token. Tokens tile the source without gaps, so
+// a lexeme runs up to the next token's start; the EOF token is empty and
+// sits at the end of the source, followed by one sentinel offset.
+//
+// Line and column are not stored; Document::span resolves them on demand.
+class TokenBuffer {
+public:
+    explicit TokenBuffer(std::string_view source = {}, std::uint64_t first_line = 1)
+        : source_(source), first_line_(first_line) {}
+
+    void push(TokenType type, std::uint64_t offset) {
+        types_.push_back(type);
+        offsets_.push_back(offset);
+    }
+
+    // Appends the EOF token and the sentinel
+    void finish() {
+        push(TokenType::EOF_, source_.size());
+        offsets_.push_back(source_.size());
+    }
+
+    std::size_t size() const { return types_.size(); }
+    bool empty() const { return types_.empty(); }
+
+    TokenType type(std::size_t i) const { return types_[i]; }
+    std::uint64_t offset(std::size_t i) const { return offsets_[i]; }
+    std::string_view lexeme(std::size_t i) const {
+        return {source_.data() + offsets_[i], offsets_[i + 1] - offsets_[i]};
+    }
+    Token operator[](std::size_t i) const { return Token(type(i), lexeme(i), offset(i)); }
+
+    std::string_view source() const { return source_; }
+    std::uint64_t first_line() const { return first_line_; }
+
+private:
+    std::string_view source_;
+    std::uint64_t first_line_;
+    std::vector<TokenType> types_;
+    std::vector<std::uint64_t> offsets_;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
-enum class TokenType {
+#include <cstdint>
+
+enum class TokenType : std::uint8_t {
     // Delimiters / symbols
     NEWLINE,
     HASH,       // '#'
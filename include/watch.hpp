@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.hpp"
+#include "emitter.hpp"
+
+class OutputBuffer;
+
+// Renders successive versions of a document, re-rendering only what an edit
+// touched. The changed bytes are found from the prefix and suffix the new
+// source shares with the last one, and widened to the blank lines around
+// them, the only block boundaries bytes elsewhere cannot move. Just that
+// window is split, parsed and rendered again; the blocks on either side are
+// taken over by position with their output.
+class IncrementalRenderer {
+public:
+    explicit IncrementalRenderer(const Emitter& emitter) : emitter_(emitter) {}
+
+    void render(std::string_view source, OutputBuffer& out);
+
+    // Renders the last source again with `emitter`, e.g. at a new terminal
+    // width, and keeps using it. Blocks are parsed again one at a time into
+    // a single reused Document, since only line breaking needs redoing.
+    void relayout(const Emitter& emitter, OutputBuffer& out);
+
+    std::size_t reused_blocks() const { return reused_; }
+    std::size_t rendered_blocks() const { return rendered_; }
+
+private:
+    // A block of source_; it starts where the previous one ends
+    struct Block {
+        std::size_t end;
+        std::size_t output_end;  // of its rendering in output_
+        std::uint64_t next_line; // first line of the next block
+    };
+
+    std::size_t block_begin(std::size_t i) const { return i == 0 ? 0 : blocks_[i - 1].end; }
+    std::size_t output_begin(std::size_t i) const {
+        return i == 0 ? 0 : blocks_[i - 1].output_end;
+    }
+    std::uint64_t first_line(std::size_t i) const {
+        return i == 0 ? 1 : blocks_[i - 1].next_line;
+    }
+    void render_block(std::string_view text, std::uint64_t line, OutputBuffer& out);
+
+    Emitter emitter_;
+    std::string source_;
+    std::string output_;
+    std::vector<Block> blocks_;
+    Document doc_; // every block is parsed into this one
+    std::size_t reused_ = 0;
+    std::size_t rendered_ = 0;
+};
+
+// Renders `path` to `out` and re-renders it every time the file is written
+// or replaced, until the process is interrupted. Uses inotify. With
+// `fit_terminal`, output is wrapped at the terminal's width and laid out
+// again whenever the terminal is resized.
+void watch_file(const std::string& path, const Emitter& emitter, OutputBuffer& out,
+                bool fit_terminal = false);
@@ -0,0 +1,109 @@
+#include "batch.hpp"
+#include "emitter.hpp"
+#include "io.hpp"
+#include "output_buffer.hpp"
+#include "pipeline.hpp"
+#include "render_cache.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
+namespace fs = std::filesystem;
+
+fs::path batch_output_path(const std::string& input, const BatchOptions& opts,
+                           std::size_t width) {
+    fs::path in(input);
+    fs::path rel = in.lexically_normal();
+    if (rel.is_absolute()) rel = rel.relative_path();
+    while (!rel.empty() && *rel.begin() == "..") rel = rel.lexically_relative("..");
+    if (rel.empty() || rel == ".") rel = in.filename();
+    if (width != 0)
+        rel.replace_extension("." + std::to_string(width) + opts.extension);
+    else
+        rel.replace_extension(opts.extension);
+    return opts.out_dir / rel;
+}
+
+namespace {
+
+// Every path `input` is written to, one per width
+std::vector<fs::path> output_paths(const std::string& input, const BatchOptions& opts) {
+    if (opts.widths.size() <= 1) return {batch_output_path(input, opts)};
+    std::vector<fs::path> paths;
+    for (std::size_t width : opts.widths) paths.push_back(batch_output_path(input, opts, width));
+    return paths;
+}
+
+} // namespace
+
+std::size_t render_batch(const std::vector<std::string>& inputs,
+                         const Emitter& emitter, const BatchOptions& opts,
+                         std::ostream& errors) {
+    ThreadPool pool(std::min(std::max<std::size_t>(opts.jobs, 1),
+                             std::max<std::size_t>(inputs.size(), 1)));
+    std::vector<std::unique_ptr<OutputBuffer>> buffers;
+    for (std::size_t i = 0; i < pool.size(); ++i)
+        buffers.push_back(std::make_unique<OutputBuffer>());
+
+    std::mutex errors_m;
+    std::size_t failed = 0;
+
+    // Inputs that map to one destination (x.termy and x.md, or one file
+    // named twice) would race on it, so none of them is written
+    std::vector<std::vector<fs::path>> dests;
+    std::map<fs::path, std::size_t> owner;
+    std::vector<bool> collides(inputs.size());
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        dests.push_back(output_paths(inputs[i], opts));
+        for (const fs::path& dest : dests[i]) {
+            auto [it, inserted] = owner.emplace(dest, i);
+            if (inserted || it->second == i) continue;
+            for (std::size_t j : {it->second, i}) {
+                if (collides[j]) continue;
+                collides[j] = true;
+                errors << "terminyl: " << inputs[j] << ": output " << dest.string()
+                       << " is also the output of another input\n";
+                ++failed;
+            }
+        }
+    }
+
+    for (std::size_t n = 0; n < inputs.size(); ++n) {
+        if (collides[n]) continue;
+        pool.submit([&, n] {
+            const std::string& input = inputs[n];
+            OutputBuffer& out = *buffers[pool.worker_index()];
+            out.clear();
+            try {
+                MappedFile source = MappedFile::open(input);
+                if (opts.widths.size() > 1) {
+                    const std::vector<std::string> rendered =
+                        render_widths(source.view(), emitter, opts.widths);
+                    for (std::size_t i = 0; i < rendered.size(); ++i) {
+                        const fs::path& dest = dests[n][i];
+                        if (dest.has_parent_path()) fs::create_directories(dest.parent_path());
+                        write_file(dest.string(), rendered[i]);
+                    }
+                    return;
+                }
+                if (opts.cache)
+                    render_cached(out, source.view(), emitter, *opts.cache);
+                else
+                    render_source(out, source.view(), emitter);
+
+                const fs::path& dest = dests[n][0];
+                if (dest.has_parent_path()) fs::create_directories(dest.parent_path());
+                write_file(dest.string(), out.str());
+            } catch (const std::exception& e) {
+                std::lock_guard lock(errors_m);
+                errors << "terminyl: " << input << ": " << e.what() << "\n";
+                ++failed;
+            }
+        });
+    }
+    pool.wait();
+    return failed;
+}
@@ -0,0 +1,240 @@
+#include "compiled_document.hpp"
+#include "line_index.hpp"
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace termyc;
+
+// Records are copied byte for byte into and out of the file
+static_assert(std::is_trivially_copyable_v<Header>);
+static_assert(std::is_trivially_copyable_v<Block>);
+static_assert(std::is_trivially_copyable_v<Inline>);
+static_assert(std::is_trivially_copyable_v<Word>);
+static_assert(sizeof(Header) % 8 == 0 && sizeof(Block) % 8 == 0 &&
+              sizeof(Inline) % 8 == 0 && sizeof(Word) % 8 == 0);
+
+namespace {
+
+constexpr std::uint64_t kMaxStrings = std::numeric_limits<std::uint32_t>::max();
+
+[[noreturn]] void invalid(const char* what) {
+    throw std::runtime_error(std::string("Invalid compiled document: ") + what);
+}
+
+bool within(std::uint64_t offset, std::uint64_t size, std::uint64_t limit) {
+    return offset <= limit && size <= limit - offset;
+}
+
+template <class T>
+std::span<const T> section(std::string_view file, const Section& s, const char* name) {
+    if (s.offset % 8 != 0 || s.count > file.size() / sizeof(T) ||
+        !within(s.offset, s.count * sizeof(T), file.size()))
+        invalid(name);
+    return {reinterpret_cast<const T*>(file.data() + s.offset), static_cast<std::size_t>(s.count)};
+}
+
+// Strings are referred to by offset: views into the source keep their
+// position, anything else (text the parser had to fold) goes after it
+class StringTable {
+public:
+    explicit StringTable(std::string_view source) : source_(source) {
+        if (source.size() > kMaxStrings) throw std::runtime_error("Source too large to compile");
+    }
+
+    std::pair<std::uint32_t, std::uint32_t> add(std::string_view s) {
+        const auto size = static_cast<std::uint32_t>(s.size());
+        if (s.empty()) return {0, 0};
+        if (s.data() >= source_.data() && s.data() + s.size() <= source_.data() + source_.size())
+            return {static_cast<std::uint32_t>(s.data() - source_.data()), size};
+        const std::uint64_t offset = source_.size() + extra_.size();
+        if (!within(offset, s.size(), kMaxStrings)) throw std::runtime_error("Source too large to compile");
+        extra_.append(s);
+        return {static_cast<std::uint32_t>(offset), size};
+    }
+
+    std::uint64_t size() const { return source_.size() + extra_.size(); }
+    std::string_view extra() const { return extra_; }
+
+private:
+    std::string_view source_;
+    std::string extra_;
+};
+
+template <class T>
+void append_records(std::string& out, Section& s, const std::vector<T>& records) {
+    out.resize((out.size() + 7) & ~std::size_t{7}, '\0');
+    s = {out.size(), records.size()};
+    out.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+}
+
+InlineKind kind_of(const Document::Inline& n) {
+    return static_cast<InlineKind>(n.node.index());
+}
+
+} // namespace
+
+std::string compile_document(const Document& doc) {
+    StringTable strings(doc.source());
+    std::vector<Block> blocks;
+    std::vector<Inline> inlines;
+    std::vector<Word> words;
+    // Children still to be laid out: the record that owns them, and the nodes.
+    // Handled in order, so every node's children end up consecutive and after it
+    struct Pending {
+        std::size_t owner;
+        bool block;
+        Document::Inline::Children nodes;
+    };
+    std::vector<Pending> pending;
+
+    blocks.reserve(doc.blocks().size());
+    for (const Document::Block& b : doc.blocks()) {
+        Block out{};
+        if (const auto* h = std::get_if<Document::Heading>(&b)) {
+            out.range = h->range;
+            out.kind = BlockKind::Heading;
+            out.level = static_cast<std::uint32_t>(h->level);
+            std::tie(out.text_offset, out.text_size) = strings.add(h->text);
+        } else {
+            const auto& p = std::get<Document::Paragraph>(b);
+            out.range = p.range;
+            out.kind = BlockKind::Paragraph;
+            out.first_word = static_cast<std::uint32_t>(words.size());
+            out.word_count = static_cast<std::uint32_t>(p.words.size());
+            for (const Document::Word& w : p.words) {
+                const auto [offset, size] = strings.add(w.text);
+                words.push_back({offset, size, w.width, static_cast<std::uint8_t>(w.style.bits()),
+                                 w.glue, w.first_in_run, 0});
+            }
+            pending.push_back({blocks.size(), true, p.inlines});
+        }
+        blocks.push_back(out);
+    }
+
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        const Pending job = pending[i];
+        const auto first = static_cast<std::uint32_t>(inlines.size());
+        const auto count = static_cast<std::uint32_t>(job.nodes.size());
+        if (job.block) {
+            blocks[job.owner].first = first;
+            blocks[job.owner].count = count;
+        } else {
+            inlines[job.owner].first = first;
+            inlines[job.owner].count = count;
+        }
+        for (Document::InlinePtr n : job.nodes) {
+            Inline out{n->range, kind_of(*n), 0, 0, 0};
+            std::visit(
+                [&](const auto& node) {
+                    if constexpr (requires { node.text; })
+                        std::tie(out.first, out.count) = strings.add(node.text);
+                    else
+                        pending.push_back({inlines.size(), false, node.children});
+                },
+                n->node);
+            inlines.push_back(out);
+        }
+    }
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof kMagic);
+    header.version = kVersion;
+    header.byte_order = kByteOrderMark;
+    header.first_line = doc.first_line();
+    header.source_size = doc.source().size();
+
+    std::string out(sizeof(Header), '\0');
+    append_records(out, header.blocks, blocks);
+    append_records(out, header.inlines, inlines);
+    append_records(out, header.words, words);
+    out.resize((out.size() + 7) & ~std::size_t{7}, '\0');
+    header.strings = {out.size(), strings.size()};
+    out.append(doc.source());
+    out.append(strings.extra());
+    std::memcpy(out.data(), &header, sizeof header);
+    return out;
+}
+
+bool CompiledDocument::is_compiled(std::string_view bytes) {
+    return bytes.size() >= sizeof kMagic && std::memcmp(bytes.data(), kMagic, sizeof kMagic) == 0;
+}
+
+CompiledDocument CompiledDocument::open(const std::string& path) {
+    return CompiledDocument(MappedFile::open(path));
+}
+
+CompiledDocument::CompiledDocument(MappedFile file) : file_(std::move(file)) {
+    const std::string_view bytes = file_.view();
+    if (!is_compiled(bytes) || bytes.size() < sizeof(Header)) invalid("bad header");
+    if (reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(Header) != 0)
+        invalid("misaligned buffer");
+    const auto& header = *reinterpret_cast<const Header*>(bytes.data());
+    if (header.version != kVersion) invalid("unsupported version");
+    if (header.byte_order != kByteOrderMark) invalid("written with another byte order");
+
+    blocks_ = section<Block>(bytes, header.blocks, "block table");
+    inlines_ = section<Inline>(bytes, header.inlines, "inline table");
+    words_ = section<Word>(bytes, header.words, "word table");
+    const auto strings = section<char>(bytes, header.strings, "string table");
+    if (strings.size() > kMaxStrings || header.source_size > strings.size())
+        invalid("string table");
+    strings_ = {strings.data(), strings.size()};
+    source_size_ = header.source_size;
+    first_line_ = header.first_line;
+
+    // Checked up front so rendering can index without bounds checks
+    auto check_text = [&](std::uint32_t offset, std::uint32_t size) {
+        if (!within(offset, size, strings_.size())) invalid("text out of range");
+    };
+    auto check_range = [&](SourceRange r) {
+        if (r.begin > r.end || r.end > source_size_) invalid("source range");
+    };
+    for (const Block& b : blocks_) {
+        check_range(b.range);
+        if (b.kind == BlockKind::Heading) {
+            check_text(b.text_offset, b.text_size);
+        } else if (b.kind == BlockKind::Paragraph) {
+            if (!within(b.first, b.count, inlines_.size()) ||
+                !within(b.first_word, b.word_count, words_.size()))
+                invalid("paragraph out of range");
+        } else {
+            invalid("block kind");
+        }
+    }
+    for (std::size_t i = 0; i < inlines_.size(); ++i) {
+        const Inline& n = inlines_[i];
+        check_range(n.range);
+        switch (n.kind) {
+        case InlineKind::Text:
+        case InlineKind::Code:
+            check_text(n.first, n.count);
+            break;
+        case InlineKind::Bold:
+        case InlineKind::Italic:
+            // Children always follow their parent, so walks terminate
+            if (n.count != 0 && (n.first <= i || !within(n.first, n.count, inlines_.size())))
+                invalid("inline children out of range");
+            break;
+        default:
+            invalid("inline kind");
+        }
+    }
+    for (const Word& w : words_) {
+        check_text(w.text_offset, w.text_size);
+        if (w.style >= 16) invalid("word style");
+    }
+}
+
+CompiledDocument::CompiledDocument(CompiledDocument&&) noexcept = default;
+CompiledDocument& CompiledDocument::operator=(CompiledDocument&&) noexcept = default;
+CompiledDocument::~CompiledDocument() = default;
+
+SourceSpan CompiledDocument::span(SourceRange r) const {
+    if (!lines_)
+        lines_ = std::make_unique<LineIndex>(source(), first_line_);
+    return {lines_->position(r.begin), lines_->position(r.end)};
+}
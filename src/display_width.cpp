@@ -0,0 +1,293 @@
+#include "display_width.hpp"
+#include <array>
+#include <iterator>
+
+namespace {
+
+struct Range {
+  char32_t lo;
+  char32_t hi;
+};
+
+// Combining marks (Mn, Me), format characters (Cf), Hangul medial/final
+// jamo and variation selectors: drawn on top of the previous cell.
+constexpr Range kZeroWidth[] = {
+    {0x0300, 0x036F},   {0x0483, 0x0489},   {0x0591, 0x05BD},
+    {0x05BF, 0x05BF},   {0x05C1, 0x05C2},   {0x05C4, 0x05C5},
+    {0x05C7, 0x05C7},   {0x0600, 0x0605},   {0x0610, 0x061A},
+    {0x061C, 0x061C},   {0x064B, 0x065F},   {0x0670, 0x0670},
+    {0x06D6, 0x06DD},   {0x06DF, 0x06E4},   {0x06E7, 0x06E8},
+    {0x06EA, 0x06ED},   {0x070F, 0x070F},   {0x0711, 0x0711},
+    {0x0730, 0x074A},   {0x07A6, 0x07B0},   {0x07EB, 0x07F3},
+    {0x0816, 0x0819},   {0x081B, 0x0823},   {0x0825, 0x0827},
+    {0x0829, 0x082D},   {0x0859, 0x085B},   {0x08D3, 0x0902},
+    {0x093A, 0x093A},   {0x093C, 0x093C},   {0x0941, 0x0948},
+    {0x094D, 0x094D},   {0x0951, 0x0957},   {0x0962, 0x0963},
+    {0x0981, 0x0981},   {0x09BC, 0x09BC},   {0x09C1, 0x09C4},
+    {0x09CD, 0x09CD},   {0x09E2, 0x09E3},   {0x0A01, 0x0A02},
+    {0x0A3C, 0x0A3C},   {0x0A41, 0x0A42},   {0x0A47, 0x0A48},
+    {0x0A4B, 0x0A4D},   {0x0A51, 0x0A51},   {0x0A70, 0x0A71},
+    {0x0A75, 0x0A75},   {0x0A81, 0x0A82},   {0x0ABC, 0x0ABC},
+    {0x0AC1, 0x0AC5},   {0x0AC7, 0x0AC8},   {0x0ACD, 0x0ACD},
+    {0x0AE2, 0x0AE3},   {0x0B01, 0x0B01},   {0x0B3C, 0x0B3C},
+    {0x0B3F, 0x0B3F},   {0x0B41, 0x0B44},   {0x0B4D, 0x0B4D},
+    {0x0B56, 0x0B56},   {0x0B62, 0x0B63},   {0x0B82, 0x0B82},
+    {0x0BC0, 0x0BC0},   {0x0BCD, 0x0BCD},   {0x0C00, 0x0C00},
+    {0x0C3E, 0x0C40},   {0x0C46, 0x0C48},   {0x0C4A, 0x0C4D},
+    {0x0C55, 0x0C56},   {0x0C62, 0x0C63},   {0x0C81, 0x0C81},
+    {0x0CBC, 0x0CBC},   {0x0CBF, 0x0CBF},   {0x0CC6, 0x0CC6},
+    {0x0CCC, 0x0CCD},   {0x0CE2, 0x0CE3},   {0x0D00, 0x0D01},
+    {0x0D41, 0x0D44},   {0x0D4D, 0x0D4D},   {0x0D62, 0x0D63},
+    {0x0DCA, 0x0DCA},   {0x0DD2, 0x0DD4},   {0x0DD6, 0x0DD6},
+    {0x0E31, 0x0E31},   {0x0E34, 0x0E3A},   {0x0E47, 0x0E4E},
+    {0x0EB1, 0x0EB1},   {0x0EB4, 0x0EBC},   {0x0EC8, 0x0ECD},
+    {0x0F18, 0x0F19},   {0x0F35, 0x0F35},   {0x0F37, 0x0F37},
+    {0x0F39, 0x0F39},   {0x0F71, 0x0F7E},   {0x0F80, 0x0F84},
+    {0x0F86, 0x0F87},   {0x0F8D, 0x0FBC},   {0x0FC6, 0x0FC6},
+    {0x102D, 0x1030},   {0x1032, 0x1037},   {0x1039, 0x103A},
+    {0x103D, 0x103E},   {0x1058, 0x1059},   {0x105E, 0x1060},
+    {0x1071, 0x1074},   {0x1082, 0x1082},   {0x1085, 0x1086},
+    {0x108D, 0x108D},   {0x109D, 0x109D},   {0x1160, 0x11FF},
+    {0x135D, 0x135F},   {0x1712, 0x1714},   {0x1732, 0x1734},
+    {0x1752, 0x1753},   {0x1772, 0x1773},   {0x17B4, 0x17B5},
+    {0x17B7, 0x17BD},   {0x17C6, 0x17C6},   {0x17C9, 0x17D3},
+    {0x17DD, 0x17DD},   {0x180B, 0x180F},   {0x1885, 0x1886},
+    {0x18A9, 0x18A9},   {0x1920, 0x1922},   {0x1927, 0x1928},
+    {0x1932, 0x1932},   {0x1939, 0x193B},   {0x1A17, 0x1A18},
+    {0x1A1B, 0x1A1B},   {0x1A56, 0x1A56},   {0x1A58, 0x1A5E},
+    {0x1A60, 0x1A60},   {0x1A62, 0x1A62},   {0x1A65, 0x1A6C},
+    {0x1A73, 0x1A7C},   {0x1A7F, 0x1A7F},   {0x1AB0, 0x1AFF},
+    {0x1B00, 0x1B03},   {0x1B34, 0x1B34},   {0x1B36, 0x1B3A},
+    {0x1B3C, 0x1B3C},   {0x1B42, 0x1B42},   {0x1B6B, 0x1B73},
+    {0x1B80, 0x1B81},   {0x1BA2, 0x1BA5},   {0x1BA8, 0x1BA9},
+    {0x1BAB, 0x1BAD},   {0x1BE6, 0x1BE6},   {0x1BE8, 0x1BE9},
+    {0x1BED, 0x1BED},   {0x1BEF, 0x1BF1},   {0x1C2C, 0x1C33},
+    {0x1C36, 0x1C37},   {0x1CD0, 0x1CD2},   {0x1CD4, 0x1CE0},
+    {0x1CE2, 0x1CE8},   {0x1CED, 0x1CED},   {0x1CF4, 0x1CF4},
+    {0x1CF8, 0x1CF9},   {0x1DC0, 0x1DFF},   {0x200B, 0x200F},
+    {0x202A, 0x202E},   {0x2060, 0x2064},   {0x2066, 0x206F},
+    {0x20D0, 0x20FF},   {0x2CEF, 0x2CF1},   {0x2D7F, 0x2D7F},
+    {0x2DE0, 0x2DFF},   {0x302A, 0x302D},   {0x3099, 0x309A},
+    {0xA66F, 0xA672},   {0xA674, 0xA67D},   {0xA69E, 0xA69F},
+    {0xA6F0, 0xA6F1},   {0xA802, 0xA802},   {0xA806, 0xA806},
+    {0xA80B, 0xA80B},   {0xA825, 0xA826},   {0xA8C4, 0xA8C5},
+    {0xA8E0, 0xA8F1},   {0xA8FF, 0xA8FF},   {0xA926, 0xA92D},
+    {0xA947, 0xA951},   {0xA980, 0xA982},   {0xA9B3, 0xA9B3},
+    {0xA9B6, 0xA9B9},   {0xA9BC, 0xA9BD},   {0xA9E5, 0xA9E5},
+    {0xAA29, 0xAA2E},   {0xAA31, 0xAA32},   {0xAA35, 0xAA36},
+    {0xAA43, 0xAA43},   {0xAA4C, 0xAA4C},   {0xAA7C, 0xAA7C},
+    {0xAAB0, 0xAAB0},   {0xAAB2, 0xAAB4},   {0xAAB7, 0xAAB8},
+    {0xAABE, 0xAABF},   {0xAAC1, 0xAAC1},   {0xAAEC, 0xAAED},
+    {0xAAF6, 0xAAF6},   {0xABE5, 0xABE5},   {0xABE8, 0xABE8},
+    {0xABED, 0xABED},   {0xD7B0, 0xD7FF},   {0xFB1E, 0xFB1E},
+    {0xFE00, 0xFE0F},   {0xFE20, 0xFE2F},   {0xFEFF, 0xFEFF},
+    {0xFFF9, 0xFFFB},   {0x101FD, 0x101FD}, {0x102E0, 0x102E0},
+    {0x10376, 0x1037A}, {0x10A01, 0x10A03}, {0x10A05, 0x10A06},
+    {0x10A0C, 0x10A0F}, {0x10A38, 0x10A3A}, {0x10A3F, 0x10A3F},
+    {0x10AE5, 0x10AE6}, {0x10D24, 0x10D27}, {0x10F46, 0x10F50},
+    {0x11001, 0x11001}, {0x11038, 0x11046}, {0x1107F, 0x11081},
+    {0x110B3, 0x110B6}, {0x110B9, 0x110BA}, {0x110BD, 0x110BD},
+    {0x11100, 0x11102}, {0x11127, 0x1112B}, {0x1112D, 0x11134},
+    {0x16AF0, 0x16AF4}, {0x16B30, 0x16B36}, {0x16F8F, 0x16F92},
+    {0x1BC9D, 0x1BC9E}, {0x1BCA0, 0x1BCA3}, {0x1D167, 0x1D169},
+    {0x1D173, 0x1D182}, {0x1D185, 0x1D18B}, {0x1D1AA, 0x1D1AD},
+    {0x1D242, 0x1D244}, {0x1DA00, 0x1DA36}, {0x1DA3B, 0x1DA6C},
+    {0x1DA75, 0x1DA75}, {0x1DA84, 0x1DA84}, {0x1DA9B, 0x1DAAF},
+    {0x1E000, 0x1E02A}, {0x1E8D0, 0x1E8D6}, {0x1E944, 0x1E94A},
+    {0xE0001, 0xE0001}, {0xE0020, 0xE007F}, {0xE0100, 0xE01EF},
+};
+
+// East Asian Wide and Fullwidth, including emoji presentation characters
+constexpr Range kWide[] = {
+    {0x1100, 0x115F},   {0x231A, 0x231B},   {0x2329, 0x232A},
+    {0x23E9, 0x23EC},   {0x23F0, 0x23F0},   {0x23F3, 0x23F3},
+    {0x25FD, 0x25FE},   {0x2614, 0x2615},   {0x2648, 0x2653},
+    {0x267F, 0x267F},   {0x2693, 0x2693},   {0x26A1, 0x26A1},
+    {0x26AA, 0x26AB},   {0x26BD, 0x26BE},   {0x26C4, 0x26C5},
+    {0x26CE, 0x26CE},   {0x26D4, 0x26D4},   {0x26EA, 0x26EA},
+    {0x26F2, 0x26F3},   {0x26F5, 0x26F5},   {0x26FA, 0x26FA},
+    {0x26FD, 0x26FD},   {0x2705, 0x2705},   {0x270A, 0x270B},
+    {0x2728, 0x2728},   {0x274C, 0x274C},   {0x274E, 0x274E},
+    {0x2753, 0x2755},   {0x2757, 0x2757},   {0x2795, 0x2797},
+    {0x27B0, 0x27B0},   {0x27BF, 0x27BF},   {0x2B1B, 0x2B1C},
+    {0x2B50, 0x2B50},   {0x2B55, 0x2B55},   {0x2E80, 0x303E},
+    {0x3041, 0x33FF},   {0x3400, 0x4DBF},   {0x4E00, 0x9FFF},
+    {0xA000, 0xA4CF},   {0xA960, 0xA97F},   {0xAC00, 0xD7A3},
+    {0xF900, 0xFAFF},   {0xFE10, 0xFE19},   {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60},   {0xFFE0, 0xFFE6},   {0x16FE0, 0x16FE4},
+    {0x17000, 0x18CFF}, {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004},
+    {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A},
+    {0x1F200, 0x1F2FF}, {0x1F300, 0x1F320}, {0x1F32D, 0x1F335},
+    {0x1F337, 0x1F37C}, {0x1F37E, 0x1F393}, {0x1F3A0, 0x1F3CA},
+    {0x1F3CF, 0x1F3D3}, {0x1F3E0, 0x1F3F0}, {0x1F3F4, 0x1F3F4},
+    {0x1F3F8, 0x1F43E}, {0x1F440, 0x1F440}, {0x1F442, 0x1F4FC},
+    {0x1F4FF, 0x1F53D}, {0x1F54B, 0x1F54E}, {0x1F550, 0x1F567},
+    {0x1F57A, 0x1F57A}, {0x1F595, 0x1F596}, {0x1F5A4, 0x1F5A4},
+    {0x1F5FB, 0x1F64F}, {0x1F680, 0x1F6C5}, {0x1F6CC, 0x1F6CC},
+    {0x1F6D0, 0x1F6D2}, {0x1F6D5, 0x1F6D7}, {0x1F6EB, 0x1F6EC},
+    {0x1F6F4, 0x1F6FC}, {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F93A},
+    {0x1F93C, 0x1F945}, {0x1F947, 0x1F9FF}, {0x1FA70, 0x1FAFF},
+    {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+
+// Two-stage lookup: one byte per 256-code-point block naming either a
+// uniform width (0, 1, 2) or one of the mixed blocks, which store 2 bits per
+// code point. Built entirely at compile time from the range lists above.
+constexpr std::size_t kBlockBits = 8;
+constexpr std::size_t kBlockSize = std::size_t{1} << kBlockBits;
+constexpr std::size_t kBlocks = 0x110000 >> kBlockBits;
+constexpr std::uint8_t kFirstMixed = 3;
+
+template <std::size_t N>
+constexpr bool sorted_disjoint(const Range (&r)[N]) {
+  for (std::size_t i = 0; i < N; ++i) {
+    if (r[i].lo > r[i].hi || (i > 0 && r[i - 1].hi >= r[i].lo))
+      return false;
+  }
+  return true;
+}
+static_assert(sorted_disjoint(kZeroWidth) && sorted_disjoint(kWide));
+
+// Index of the first range in `r` at or after `i` that does not end before
+// `cp`. Blocks and code points are visited in increasing order, so each list
+// is walked once while the tables are built.
+template <std::size_t N>
+constexpr std::size_t seek(const Range (&r)[N], std::size_t i, char32_t cp) {
+  while (i < N && r[i].hi < cp)
+    ++i;
+  return i;
+}
+
+struct Cursor {
+  std::size_t zero = 0;
+  std::size_t wide = 0;
+};
+
+// Zero width wins where the lists overlap (e.g. combining kana marks)
+constexpr std::uint8_t width_at(Cursor &c, char32_t cp) {
+  c.zero = seek(kZeroWidth, c.zero, cp);
+  if (c.zero < std::size(kZeroWidth) && kZeroWidth[c.zero].lo <= cp)
+    return 0;
+  c.wide = seek(kWide, c.wide, cp);
+  if (c.wide < std::size(kWide) && kWide[c.wide].lo <= cp)
+    return 2;
+  return 1;
+}
+
+// Uniform width of the block, or kFirstMixed if it is mixed
+constexpr std::uint8_t block_kind(Cursor &c, std::size_t block) {
+  const auto lo = static_cast<char32_t>(block << kBlockBits);
+  const auto hi = static_cast<char32_t>(lo + kBlockSize - 1);
+  c.zero = seek(kZeroWidth, c.zero, lo);
+  c.wide = seek(kWide, c.wide, lo);
+  const bool zero =
+      c.zero < std::size(kZeroWidth) && kZeroWidth[c.zero].lo <= hi;
+  const bool wide = c.wide < std::size(kWide) && kWide[c.wide].lo <= hi;
+  if (!zero && !wide)
+    return 1;
+  if (!wide && kZeroWidth[c.zero].lo <= lo && kZeroWidth[c.zero].hi >= hi)
+    return 0;
+  if (!zero && kWide[c.wide].lo <= lo && kWide[c.wide].hi >= hi)
+    return 2;
+  return kFirstMixed;
+}
+
+constexpr std::size_t count_mixed() {
+  Cursor c;
+  std::size_t n = 0;
+  for (std::size_t b = 0; b < kBlocks; ++b)
+    n += block_kind(c, b) == kFirstMixed;
+  return n;
+}
+
+constexpr std::size_t kMixedBlocks = count_mixed();
+static_assert(kFirstMixed + kMixedBlocks <= 256);
+
+struct Tables {
+  std::array<std::uint8_t, kBlocks> stage1{};
+  std::array<std::array<std::uint8_t, kBlockSize / 4>, kMixedBlocks> stage2{};
+};
+
+constexpr Tables build_tables() {
+  Tables t;
+  Cursor blocks;
+  std::size_t mixed = 0;
+  for (std::size_t b = 0; b < kBlocks; ++b) {
+    std::uint8_t kind = block_kind(blocks, b);
+    if (kind != kFirstMixed) {
+      t.stage1[b] = kind;
+      continue;
+    }
+    t.stage1[b] = static_cast<std::uint8_t>(kFirstMixed + mixed);
+    Cursor points = blocks;
+    for (std::size_t i = 0; i < kBlockSize; ++i) {
+      auto cp = static_cast<char32_t>((b << kBlockBits) + i);
+      t.stage2[mixed][i / 4] |=
+          static_cast<std::uint8_t>(width_at(points, cp) << ((i % 4) * 2));
+    }
+    ++mixed;
+  }
+  return t;
+}
+
+constexpr Tables kTables = build_tables();
+
+static_assert(kTables.stage1[0] == 1);
+static_assert(kTables.stage1[0x4E00 >> kBlockBits] == 2);
+
+} // namespace
+
+int codepoint_width(char32_t cp) {
+  if (cp >= 0x110000)
+    return 1;
+  std::uint8_t kind = kTables.stage1[cp >> kBlockBits];
+  if (kind < kFirstMixed)
+    return kind;
+  const std::size_t i = cp & (kBlockSize - 1);
+  return (kTables.stage2[kind - kFirstMixed][i / 4] >> ((i % 4) * 2)) & 3;
+}
+
+std::size_t display_width_detail::utf8_width(std::string_view s) {
+  const auto *p = reinterpret_cast<const unsigned char *>(s.data());
+  const auto *end = p + s.size();
+  std::size_t width = 0;
+
+  while (p < end) {
+    const unsigned char c = *p;
+    if (c < 0x80) {
+      ++width;
+      ++p;
+      continue;
+    }
+
+    std::size_t len = 0;
+    char32_t cp = 0;
+    if ((c & 0xE0) == 0xC0) {
+      len = 2;
+      cp = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+      len = 3;
+      cp = c & 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+      len = 4;
+      cp = c & 0x07;
+    }
+
+    bool valid = len != 0 && static_cast<std::size_t>(end - p) >= len;
+    for (std::size_t k = 1; valid && k < len; ++k) {
+      if ((p[k] & 0xC0) != 0x80)
+        valid = false;
+      else
+        cp = (cp << 6) | (p[k] & 0x3F);
+    }
+    if (!valid) {
+      ++width;
+      ++p;
+      continue;
+    }
+
+    width += static_cast<std::size_t>(codepoint_width(cp));
+    p += len;
+  }
+  return width;
+}
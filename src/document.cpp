@@ -1,17 +1,179 @@
 #include "document.hpp"
+#include "display_width.hpp"
+#include "line_index.hpp"
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <new>
+#include <type_traits>
 
-Document::Inline::Ptr Document::Inline::make_text(std::string s, SourceSpan sp) {
-    return std::make_shared<Inline>(Text{std::move(s)}, sp);
+// Nodes are never destroyed individually, the arena drops them all at once
+static_assert(std::is_trivially_destructible_v<Document::Inline>);
+static_assert(std::is_trivially_destructible_v<Document::Word>);
+
+namespace {
+constexpr std::size_t kArenaInitialBytes = 4096;
+
+bool is_punctuation(std::string_view s) {
+    bool saw_char = false;
+    for (unsigned char c : s) {
+        if (std::isspace(c)) continue;
+        saw_char = true;
+        if (!std::ispunct(c)) return false;
+    }
+    return saw_char;
+}
+
+void split_words(std::string_view s, StyleState style, std::vector<Document::Word> &out) {
+    std::size_t i = 0;
+    bool first_word_in_run = true;
+
+    while (i < s.size()) {
+        while (i < s.size() && std::isspace((unsigned char)s[i]))
+            ++i;
+        if (i >= s.size())
+            break;
+
+        std::size_t start = i;
+        unsigned char seen = 0;
+        while (i < s.size() && !std::isspace((unsigned char)s[i]))
+            seen |= static_cast<unsigned char>(s[i++]);
+        std::string_view word = s.substr(start, i - start);
+        // The scan already tells whether the word is ASCII, one column per byte
+        auto width = seen < 0x80 ? word.size() : display_width(word);
+
+        out.push_back(Document::Word{word, static_cast<std::uint32_t>(width), style,
+                                     is_punctuation(word), first_word_in_run});
+        first_word_in_run = false;
+    }
+}
+
+// Walks the tree with an explicit stack, so deeply nested input cannot
+// exhaust the call stack
+void collect_words(Document::Inline::Children inlines, std::vector<Document::Word> &out) {
+    struct Level {
+        Document::Inline::Children nodes;
+        std::size_t next;
+        StyleState style;
+    };
+    thread_local std::vector<Level> levels;
+    levels.clear();
+    levels.push_back({inlines, 0, StyleState{}});
+
+    while (!levels.empty()) {
+        Level &top = levels.back();
+        if (top.next == top.nodes.size()) {
+            levels.pop_back();
+            continue;
+        }
+        const Document::Inline &n = *top.nodes[top.next++];
+        StyleState child = top.style;
+        std::visit(
+            [&](auto const &node) {
+                using T = std::remove_cvref_t<decltype(node)>;
+                if constexpr (std::is_same_v<T, Document::Inline::Text>) {
+                    split_words(node.text, child, out);
+                } else if constexpr (std::is_same_v<T, Document::Inline::Bold>) {
+                    child.bold = true;
+                    levels.push_back({node.children, 0, child});
+                } else if constexpr (std::is_same_v<T, Document::Inline::Italic>) {
+                    child.italic = true;
+                    levels.push_back({node.children, 0, child});
+                } else if constexpr (std::is_same_v<T, Document::Inline::Code>) {
+                    child.code = true;
+                    split_words(node.text, child, out);
+                }
+            },
+            n.node);
+    }
+}
+} // namespace
+
+Document::Document()
+    : arena_(std::make_unique<std::pmr::monotonic_buffer_resource>(
+          kArenaInitialBytes)) {}
+
+Document::Document(Document &&) noexcept = default;
+Document &Document::operator=(Document &&) noexcept = default;
+Document::~Document() = default;
+
+void Document::reset() {
+    blocks_.clear();
+    source_ = {};
+    first_line_ = 1;
+    lines_.reset();
+    if (arena_used_ > arena_capacity_) {
+        // Headroom so a slightly larger document does not reallocate
+        arena_capacity_ = std::max(arena_used_ + arena_used_ / 2, kArenaInitialBytes);
+        arena_.reset();
+        arena_buffer_ = std::make_unique_for_overwrite<std::byte[]>(arena_capacity_);
+        arena_ = std::make_unique<std::pmr::monotonic_buffer_resource>(
+            arena_buffer_.get(), arena_capacity_);
+    } else {
+        arena_->release();
+    }
+    arena_used_ = 0;
+}
+
+void *Document::allocate(std::size_t bytes, std::size_t align) {
+    arena_used_ += bytes + align - 1;
+    return arena_->allocate(bytes, align);
+}
+
+SourceSpan Document::span(SourceRange r) const {
+    if (!lines_)
+        lines_ = std::make_unique<LineIndex>(source_, first_line_);
+    return {lines_->position(r.begin), lines_->position(r.end)};
+}
+
+template <class Node>
+Document::InlinePtr Document::make(Node n, SourceRange r) {
+    void *mem = allocate(sizeof(Inline), alignof(Inline));
+    return new (mem) Inline(n, r);
+}
+
+Document::InlinePtr Document::make_text(std::string_view s, SourceRange r) {
+    return make(Inline::Text{s}, r);
+}
+
+Document::InlinePtr Document::make_bold(Inline::Children children, SourceRange r) {
+    return make(Inline::Bold{children}, r);
+}
+
+Document::InlinePtr Document::make_code(std::string_view s, SourceRange r) {
+    return make(Inline::Code{s}, r);
+}
+
+Document::InlinePtr Document::make_italic(Inline::Children children, SourceRange r) {
+    return make(Inline::Italic{children}, r);
 }
 
-Document::Inline::Ptr Document::Inline::make_bold(std::vector<Ptr> children, SourceSpan sp) {
-    return std::make_shared<Inline>(Bold{std::move(children)}, sp);
+Document::Inline::Children Document::make_children(std::span<const InlinePtr> nodes) {
+    if (nodes.empty())
+        return {};
+    void *mem = allocate(nodes.size_bytes(), alignof(InlinePtr));
+    auto *out = static_cast<InlinePtr *>(mem);
+    std::copy(nodes.begin(), nodes.end(), out);
+    return {out, nodes.size()};
 }
 
-Document::Inline::Ptr Document::Inline::make_code(std::string s, SourceSpan sp) {
-    return std::make_shared<Inline>(Code{std::move(s)}, sp);
+std::string_view Document::intern(std::string_view s) {
+    if (s.empty())
+        return {};
+    auto *out = static_cast<char *>(allocate(s.size(), 1));
+    std::copy(s.begin(), s.end(), out);
+    return {out, s.size()};
 }
 
-Document::Inline::Ptr Document::Inline::make_italic(std::vector<Ptr> children, SourceSpan sp) {
-    return std::make_shared<Inline>(Italic{std::move(children)}, sp);
+Document::Words Document::make_words(Inline::Children inlines) {
+    // Gathered here first because the arena copy needs the final count
+    thread_local std::vector<Word> words;
+    words.clear();
+    collect_words(inlines, words);
+    if (words.empty())
+        return {};
+    void *mem = allocate(words.size() * sizeof(Word), alignof(Word));
+    auto *out = static_cast<Word *>(mem);
+    std::uninitialized_copy(words.begin(), words.end(), out);
+    return {out, words.size()};
 }
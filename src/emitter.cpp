@@ -1,12 +1,132 @@
 #include "emitter.hpp"
-#include <iostream>
-#include <sstream>
+#include "compiled_document.hpp"
+#include "display_width.hpp"
+#include "line_breaker.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <ostream>
 #include <string_view>
 #include <variant>
 
-Emitter::Emitter(Style s) : style_(std::move(s)) {}
+namespace {
 
-void Emitter::render(std::ostream &out, const Document &doc) const {
+struct BoxChars {
+  const char *top_left;
+  const char *top_right;
+  const char *bottom_left;
+  const char *bottom_right;
+  const char *horizontal;
+  const char *vertical;
+};
+
+// Box style chosen based on heading level
+BoxChars unicode_box(int level) {
+  switch (level) {
+  case 1: // h1 ('=')
+    return {"╔", "╗", "╚", "╝", "═", "║"};
+  case 2: // h2 ('==')
+    return {"┏", "┓", "┗", "┛", "━", "┃"};
+  case 3: // h3 ('===')
+    return {"┌", "┐", "└", "┘", "─", "│"};
+  default: // >= h4 ('====')
+    return {"╭", "╮", "╰", "╯", "─", "│"};
+  }
+}
+
+// Same levels drawn with ASCII only, for logs and dumb terminals
+BoxChars ascii_box(int level) {
+  switch (level) {
+  case 1:
+    return {"#", "#", "#", "#", "=", "#"};
+  case 2:
+    return {"+", "+", "+", "+", "=", "|"};
+  case 3:
+    return {"+", "+", "+", "+", "-", "|"};
+  default:
+    return {".", ".", "'", "'", "-", "|"};
+  }
+}
+
+void append_escaped(OutputBuffer &out, std::string_view s) {
+  for (;;) {
+    std::size_t i = s.find_first_of("<>&\"");
+    out.append(s.substr(0, i));
+    if (i == std::string_view::npos)
+      return;
+    switch (s[i]) {
+    case '<': out.append("&lt;"); break;
+    case '>': out.append("&gt;"); break;
+    case '&': out.append("&amp;"); break;
+    default: out.append("&quot;"); break;
+    }
+    s.remove_prefix(i + 1);
+  }
+}
+
+} // namespace
+
+// A backend supplies the heading and paragraph framing, the bytes that switch
+// from one StyleState to another and the way text is written. kStyled = false
+// lets the emitter drop style tracking altogether.
+struct AnsiBackend {
+  static constexpr bool kStyled = true;
+  static constexpr bool kBoxes = true;
+
+  static BoxChars box(int level) { return unicode_box(level); }
+  static void paragraph_begin(OutputBuffer &) {}
+  static void paragraph_end(OutputBuffer &out) { out.append('\n'); }
+  static std::string_view transition(StyleState from, StyleState to) {
+    return sgr_transition(from, to);
+  }
+  static void text(OutputBuffer &out, std::string_view s) { out.append(s); }
+};
+
+struct PlainBackend {
+  static constexpr bool kStyled = false;
+  static constexpr bool kBoxes = true;
+
+  static BoxChars box(int level) { return ascii_box(level); }
+  static void paragraph_begin(OutputBuffer &) {}
+  static void paragraph_end(OutputBuffer &out) { out.append('\n'); }
+  static std::string_view transition(StyleState, StyleState) { return {}; }
+  static void text(OutputBuffer &out, std::string_view s) { out.append(s); }
+};
+
+struct HtmlBackend {
+  static constexpr bool kStyled = true;
+  static constexpr bool kBoxes = false;
+
+  static void heading(OutputBuffer &out, std::string_view s, int level) {
+    const char digit = static_cast<char>('0' + std::clamp(level, 1, 6));
+    const std::size_t first = s.find_first_not_of(' ');
+    s = first == std::string_view::npos
+            ? std::string_view{}
+            : s.substr(first, s.find_last_not_of(' ') - first + 1);
+    out.append("<h");
+    out.append(digit);
+    out.append('>');
+    append_escaped(out, s);
+    out.append("</h");
+    out.append(digit);
+    out.append(">\n");
+  }
+  static void paragraph_begin(OutputBuffer &out) { out.append("<p>"); }
+  static void paragraph_end(OutputBuffer &out) { out.append("</p>\n"); }
+  static std::string_view transition(StyleState from, StyleState to) {
+    return html_transition(from, to);
+  }
+  static void text(OutputBuffer &out, std::string_view s) {
+    // Words rarely contain markup characters; skip the search for most
+    if (s.find_first_of("<>&\"") == std::string_view::npos)
+      out.append(s);
+    else
+      append_escaped(out, s);
+  }
+};
+
+template <class Backend>
+void BasicEmitter<Backend>::render(OutputBuffer &out,
+                                   const Document &doc) const {
   for (const auto &blk : doc.blocks()) {
     // Type-based dispatch
     std::visit(
@@ -14,176 +134,178 @@ void Emitter::render(std::ostream &out, const Document &doc) const {
           using T = std::remove_cvref_t<decltype(b)>;
 
           if constexpr (std::is_same_v<T, Document::Heading>) {
-            out << box_heading(b.text, b.level) << "\n";
+            box_heading(out, b.text, b.level);
           } else if constexpr (std::is_same_v<T, Document::Paragraph>) {
-            wrap_paragraph(out, b.inlines, style_.width,
+            wrap_paragraph(out, b.words, style_.width,
                            style_.paragraph_indent);
-            out << "\n";
           }
+          if constexpr (Backend::kBoxes)
+            out.append('\n');
         },
         blk);
   }
 }
 
-std::string Emitter::render_to_string(const Document &doc) const {
-  std::ostringstream out;
-  render(out, doc);
-  return out.str();
-}
-
-std::string Emitter::box_heading(std::string_view s, int level, std::size_t pad) const {
-  const std::size_t w = s.size();
-  const std::size_t inner = w + 2 * pad;
-  
-  // Box style chosen based on heading level
-  struct BoxChars {
-    const char* top_left;
-    const char* top_right;
-    const char* bottom_left;
-    const char* bottom_right;
-    const char* horizontal;
-    const char* vertical;
-  };
-  
-  BoxChars chars;
-  switch (level) {
-    case 1:  // h1 ('=')
-      chars = {"╔", "╗", "╚", "╝", "═", "║"};
-      break;
-    case 2:  // h2 ('==')
-      chars = {"┏", "┓", "┗", "┛", "━", "┃"};
-      break;
-    case 3:  // h3 ('===')
-      chars = {"┌", "┐", "└", "┘", "─", "│"};
-      break;
-    default:  // >= h4 ('====')
-      chars = {"╭", "╮", "╰", "╯", "─", "│"};
-      break;
-  }
-  
-  std::string horizontal_line;
-  for (std::size_t i = 0; i < inner + 2; ++i) {
-    horizontal_line += chars.horizontal;
+template <class Backend>
+void BasicEmitter<Backend>::render(OutputBuffer &out,
+                                   const CompiledDocument &doc) const {
+  for (const termyc::Block &b : doc.blocks()) {
+    if (b.kind == termyc::BlockKind::Heading)
+      box_heading(out, doc.text(b.text_offset, b.text_size),
+                  static_cast<int>(b.level));
+    else
+      wrap_paragraph(out, doc.words(b), style_.width, style_.paragraph_indent);
+    if constexpr (Backend::kBoxes)
+      out.append('\n');
   }
-  
-  std::string out;
-  out += chars.top_left + horizontal_line + chars.top_right + "\n";
-  out += std::string(chars.vertical) + std::string(pad + 1, ' ') + 
-         std::string(s) + std::string(pad + 1, ' ') + chars.vertical + "\n";
-  out += chars.bottom_left + horizontal_line + chars.bottom_right + "\n";
-  
-  return out;
 }
 
-void Emitter::flatten_runs(const std::vector<Document::InlinePtr> &inlines,
-                           StyleState current_style,
-                           std::vector<Run> &out) const {
-  for (auto const &p : inlines) {
-    std::visit(
-        [&](auto const &node) {
-          using T = std::remove_cvref_t<decltype(node)>;
-          if constexpr (std::is_same_v<T, Document::Inline::Text>) {
-            bool glue_left = is_punctuation(node.text);
-            out.push_back(Run{node.text, current_style, glue_left});
-          } else if constexpr (std::is_same_v<T, Document::Inline::Bold>) {
-            StyleState child_style = current_style;
-            child_style.bold = true;
-            flatten_runs(node.children, child_style, out);
-          } else if constexpr (std::is_same_v<T, Document::Inline::Italic>) {
-            StyleState child_style = current_style;
-            child_style.italic = true;
-            flatten_runs(node.children, child_style, out);
-          } else if constexpr (std::is_same_v<T, Document::Inline::Code>) {
-            StyleState child_style = current_style;
-            child_style.code = true;
-            out.push_back(Run{node.text, child_style});
-          }
-        },
-        p->node);
+template <class Backend>
+void BasicEmitter<Backend>::box_heading(OutputBuffer &out, std::string_view s,
+                                        int level, std::size_t pad) const {
+  if constexpr (!Backend::kBoxes) {
+    Backend::heading(out, s, level);
+  } else {
+    const std::size_t w = display_width(s);
+    const std::size_t inner = w + 2 * pad;
+    const BoxChars chars = Backend::box(level);
+
+    auto horizontal_line = [&](const char *left, const char *right) {
+      out.append(left);
+      for (std::size_t i = 0; i < inner + 2; ++i) {
+        out.append(chars.horizontal);
+      }
+      out.append(right);
+      out.append('\n');
+    };
+
+    horizontal_line(chars.top_left, chars.top_right);
+    out.append(chars.vertical);
+    out.fill(' ', pad + 1);
+    out.append(s);
+    out.fill(' ', pad + 1);
+    out.append(chars.vertical);
+    out.append('\n');
+    horizontal_line(chars.bottom_left, chars.bottom_right);
   }
 }
 
-void Emitter::wrap_paragraph(std::ostream &out,
-                             const std::vector<Document::InlinePtr> &inlines,
-                             std::size_t width, std::size_t indent) const {
+template <class Backend>
+template <class Words>
+void BasicEmitter<Backend>::wrap_paragraph(OutputBuffer &out, Words words,
+                                           std::size_t width,
+                                           std::size_t indent) const {
+  thread_local std::vector<std::size_t> breaks;
+  breaks.clear();
+
+  if (style_.wrap == WrapMode::Optimal)
+    optimal_breaks(words, width, indent, breaks);
+  else
+    greedy_breaks(words, width, indent, breaks);
+
   std::size_t line_len = 0;
   auto write_indent = [&]() {
-    out << std::string(indent, ' ');
+    out.fill(' ', indent);
     line_len = indent;
   };
 
+  Backend::paragraph_begin(out);
   write_indent();
 
-  std::vector<Run> runs;
-  flatten_runs(inlines, StyleState{}, runs);
-
   StyleState current_state;
+  std::size_t next_break = 0;
+  auto switch_to = [&](StyleState next) {
+    const std::string_view seq = Backend::transition(current_state, next);
+    TERMINYL_STATS_ADD(escape_bytes, seq.size());
+    out.append(seq);
+    current_state = next;
+  };
 
-  for (size_t run_idx = 0; run_idx < runs.size(); ++run_idx) {
-    auto const &r = runs[run_idx];
-    std::string_view s = r.text;
-    std::size_t i = 0;
-    
-    bool first_word_in_run = true;
-
-    while (i < s.size()) {
-      // skip whitespace
-      while (i < s.size() && std::isspace((unsigned char)s[i]))
-        ++i;
-      if (i >= s.size())
-        break;
-
-      // extract word
-      std::size_t start = i;
-      while (i < s.size() && !std::isspace((unsigned char)s[i]))
-        ++i;
-      std::string_view word = s.substr(start, i - start);
-      auto word_len = word.size();
-
-      // Check if wrap necessary
-      bool needs_wrap =
-          (line_len != indent) && (line_len + 1 + word_len > width);
-
-      if (needs_wrap) {
-        out << '\n';
-        write_indent();
-      } else if (line_len != indent && !is_punctuation(word)) {
-        if (first_word_in_run && current_state != r.style && current_state != StyleState{}) {
-          out << "\x1b[0m"; 
-          out << ' ';
-          line_len += 1;
-        } else {
-          out << ' ';
-          line_len += 1;
-        }
-      }
+  for (std::size_t k = 0; k < words.size(); ++k) {
+    const Document::Word &w = words[k];
 
-      // Apply style if changed
-      if (current_state != r.style) {
-        out << r.style.to_ansi();
-        current_state = r.style;
+    if (next_break < breaks.size() && breaks[next_break] == k) {
+      ++next_break;
+      if constexpr (Backend::kStyled) {
+        if (style_.close_styles_per_line && current_state != StyleState{})
+          switch_to(StyleState{});
+      }
+      out.append('\n');
+      write_indent();
+    } else if (line_len != indent && !w.glue) {
+      // Between runs the space only keeps what both neighbours share, so
+      // e.g. a code span's reverse video does not spill onto it
+      if constexpr (Backend::kStyled) {
+        if (w.first_in_run && current_state != w.style)
+          switch_to(current_state.common(w.style));
       }
+      out.append(' ');
+      line_len += 1;
+    }
 
-      out << word;
-      line_len += word_len;
-      first_word_in_run = false;
+    if constexpr (Backend::kStyled) {
+      if (current_state != w.style)
+        switch_to(w.style);
     }
+    Backend::text(out, w.text);
+    line_len += w.width;
   }
 
   // Reset styles
-  if (current_state != StyleState{}) {
-    out << "\x1b[0m";
-  }
-  out << '\n';
+  if constexpr (Backend::kStyled)
+    switch_to(StyleState{});
+  Backend::paragraph_end(out);
 }
 
+template class BasicEmitter<AnsiBackend>;
+template class BasicEmitter<PlainBackend>;
+template class BasicEmitter<HtmlBackend>;
 
-bool Emitter::is_punctuation(std::string_view s) const {
-  bool saw_char = false;
-  for (unsigned char c : s) {
-    if (std::isspace(c)) continue;
-    saw_char = true;
-    if (!std::ispunct(c)) return false;
+Emitter::Emitter(Style s) : style_(std::move(s)) {}
+
+Emitter Emitter::with_width(std::size_t width) const {
+  Style s = style_;
+  s.width = width;
+  return Emitter(s);
+}
+
+void Emitter::render(OutputBuffer &out, const Document &doc) const {
+  switch (style_.format) {
+  case OutputFormat::Plain:
+    PlainEmitter(style_).render(out, doc);
+    return;
+  case OutputFormat::Html:
+    HtmlEmitter(style_).render(out, doc);
+    return;
+  case OutputFormat::Ansi:
+    break;
   }
-  return saw_char;
-}
\ No newline at end of file
+  AnsiEmitter(style_).render(out, doc);
+}
+
+void Emitter::render(OutputBuffer &out, const CompiledDocument &doc) const {
+  switch (style_.format) {
+  case OutputFormat::Plain:
+    PlainEmitter(style_).render(out, doc);
+    return;
+  case OutputFormat::Html:
+    HtmlEmitter(style_).render(out, doc);
+    return;
+  case OutputFormat::Ansi:
+    break;
+  }
+  AnsiEmitter(style_).render(out, doc);
+}
+
+void Emitter::render(std::ostream &out, const Document &doc) const {
+  const std::string s = render_to_string(doc);
+  out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+std::string Emitter::render_to_string(const Document &doc) const {
+  // Escapes, indents and box drawing add a little on top of the source
+  OutputBuffer out;
+  out.reserve(doc.source().size() + doc.source().size() / 4 + 256);
+  render(out, doc);
+  return out.take();
+}
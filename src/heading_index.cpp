@@ -0,0 +1,151 @@
+#include "heading_index.hpp"
+#include "block_splitter.hpp"
+#include "hash.hpp"
+#include "render_cache.hpp"
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <sys/stat.h>
+
+namespace {
+
+// Bump whenever the serialized form below or what the scan finds changes
+constexpr std::uint64_t kIndexFormatVersion = 3;
+
+// Mirrors the lexer: the marks are a HEADING_MARK token and the heading's
+// text is the TEXT token after them, which ends at the next structural byte
+HeadingEntry heading_at(std::string_view source, std::uint64_t offset, std::uint64_t line) {
+    std::string_view rest = source.substr(offset);
+    const std::size_t marks = std::min(rest.find_first_not_of('='), rest.size());
+    rest.remove_prefix(marks);
+    // The title is the TEXT token after the marks; these lex as tokens of
+    // their own, so a heading starting with one has no title
+    if (!rest.empty() && std::string_view("()[],#").find(rest[0]) != std::string_view::npos) rest = {};
+    rest = rest.substr(0, rest.find_first_of("\n*_`"));
+    const std::size_t first = rest.find_first_not_of(' ');
+    if (first == std::string_view::npos)
+        rest = {};
+    else
+        rest = rest.substr(first, rest.find_last_not_of(' ') - first + 1);
+    return {offset, line, static_cast<int>(marks), std::string(rest)};
+}
+
+// Calls on_heading(heading) for every heading in order until it returns
+// false. The source is fed whole and final, so the splitter can always tell
+// whether a backtick opens a code span and misses no boundary.
+template <class OnHeading>
+void scan_headings(std::string_view source, OnHeading&& on_heading) {
+    if (!source.empty() && source[0] == '=' && !on_heading(heading_at(source, 0, 1))) return;
+
+    BlockSplitter splitter;
+    splitter.feed(source, [&](std::size_t offset, std::uint64_t line) {
+        return offset == source.size() || source[offset] != '=' ||
+               on_heading(heading_at(source, offset, line));
+    }, true);
+}
+
+std::string serialize(const std::vector<HeadingEntry>& headings) {
+    std::string out;
+    for (const HeadingEntry& h : headings) {
+        out += std::to_string(h.offset) + '\t' + std::to_string(h.line) + '\t' +
+               std::to_string(h.level) + '\t' + h.title + '\n';
+    }
+    return out;
+}
+
+template <class T> bool parse_field(std::string_view& s, T& out) {
+    const std::size_t tab = s.find('\t');
+    if (tab == std::string_view::npos) return false;
+    const auto [end, ec] = std::from_chars(s.data(), s.data() + tab, out);
+    if (ec != std::errc{} || end != s.data() + tab) return false;
+    s.remove_prefix(tab + 1);
+    return true;
+}
+
+std::optional<std::vector<HeadingEntry>> deserialize(std::string_view s, std::uint64_t source_size) {
+    std::vector<HeadingEntry> headings;
+    while (!s.empty()) {
+        const std::size_t nl = s.find('\n');
+        if (nl == std::string_view::npos) return std::nullopt;
+        std::string_view row = s.substr(0, nl);
+        s.remove_prefix(nl + 1);
+        HeadingEntry h{};
+        if (!parse_field(row, h.offset) || !parse_field(row, h.line) ||
+            !parse_field(row, h.level) || h.offset >= source_size)
+            return std::nullopt;
+        h.title = row;
+        headings.push_back(std::move(h));
+    }
+    return headings;
+}
+
+} // namespace
+
+std::vector<HeadingEntry> index_headings(std::string_view source) {
+    std::vector<HeadingEntry> headings;
+    scan_headings(source, [&](HeadingEntry h) {
+        headings.push_back(std::move(h));
+        return true;
+    });
+    return headings;
+}
+
+std::optional<SectionRange> find_section(std::string_view source, std::string_view title) {
+    std::optional<SectionRange> found;
+    int level = 0;
+    scan_headings(source, [&](HeadingEntry h) {
+        if (found) {
+            if (h.level > level) return true;
+            found->end = h.offset;
+            return false;
+        }
+        if (h.title == title) {
+            found = SectionRange{h.offset, source.size(), h.line};
+            level = h.level;
+        }
+        return true;
+    });
+    return found;
+}
+
+std::optional<SectionRange> find_section(const std::vector<HeadingEntry>& headings,
+                                         std::uint64_t source_size, std::string_view title) {
+    for (std::size_t i = 0; i < headings.size(); ++i) {
+        if (headings[i].title != title) continue;
+        SectionRange found{headings[i].offset, source_size, headings[i].line};
+        for (std::size_t j = i + 1; j < headings.size(); ++j) {
+            if (headings[j].level <= headings[i].level) {
+                found.end = headings[j].offset;
+                break;
+            }
+        }
+        return found;
+    }
+    return std::nullopt;
+}
+
+std::vector<HeadingEntry> cached_headings(const std::string& path, std::string_view source,
+                                          RenderCache& cache) {
+    struct stat st {};
+    std::error_code ec;
+    const std::filesystem::path abs = std::filesystem::absolute(path, ec);
+    if (path == "-" || ec || ::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) ||
+        static_cast<std::uint64_t>(st.st_size) != source.size())
+        return index_headings(source);
+
+    using namespace hash_detail;
+    std::uint64_t id = mix(kIndexFormatVersion ^ kP0, static_cast<std::uint64_t>(st.st_size) ^ kP1);
+    id = mix(id, static_cast<std::uint64_t>(st.st_mtim.tv_sec) ^ kP2);
+    id = mix(id, static_cast<std::uint64_t>(st.st_mtim.tv_nsec) ^ kP0);
+    id = mix(id, static_cast<std::uint64_t>(st.st_ino) ^ kP1);
+    const std::string name = abs.string();
+    // A different seed pair from render_cache.cpp keeps these apart from blocks
+    const RenderCache::Key key{hash_bytes(name, id ^ kP2), hash_bytes(name, id + kP1)};
+
+    if (auto stored = cache.load(key)) {
+        if (auto headings = deserialize(*stored, source.size())) return *headings;
+    }
+    std::vector<HeadingEntry> headings = index_headings(source);
+    cache.store(key, serialize(headings));
+    return headings;
+}
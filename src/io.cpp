@@ -1,14 +1,54 @@
 #include "io.hpp"
+#include "stats.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
-#include <sstream>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
 
+namespace {
+
+std::string read_fd(int fd, const std::string& path) {
+    TERMINYL_STATS_STAGE(read);
+    std::string out;
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        out.reserve(static_cast<std::size_t>(st.st_size));
+    char buf[64 * 1024];
+    for (;;) {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Failed to read file: " + path + ": " +
+                                     std::strerror(errno));
+        }
+        if (n == 0) break;
+        out.append(buf, static_cast<std::size_t>(n));
+    }
+    TERMINYL_STATS_ADD(bytes_in, out.size());
+    return out;
+}
+
+} // namespace
+
+// Plain reads rather than a mapping: callers that keep the copy around, such
+// as watch mode, must not fault if the file is truncated while being read.
 std::string read_file(const std::string& path) {
-    std::ifstream f(path, std::ios::binary);
-    if (!f) throw std::runtime_error("Failed to open file: " + path);
-    std::ostringstream ss;
-    ss << f.rdbuf();
-    return ss.str();
+    if (path == "-") return read_fd(STDIN_FILENO, path);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("Failed to open file: " + path);
+    try {
+        std::string out = read_fd(fd, path);
+        ::close(fd);
+        return out;
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
 }
 
 void write_file(const std::string& path, std::string_view contents) {
@@ -16,4 +56,65 @@ void write_file(const std::string& path, std::string_view contents) {
     if (!f) throw std::runtime_error("Failed to open file for write: " + path);
     f.write(contents.data(), static_cast<std::streamsize>(contents.size()));
     if (!f) throw std::runtime_error("Failed to write file: " + path);
+    TERMINYL_STATS_ADD(bytes_out, contents.size());
+}
+
+MappedFile MappedFile::open(const std::string& path) {
+    MappedFile file;
+    if (path == "-") {
+        file.owned_ = read_fd(STDIN_FILENO, path);
+        file.view_ = file.owned_;
+        return file;
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("Failed to open file: " + path);
+
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        TERMINYL_STATS_STAGE(read);
+        auto size = static_cast<std::size_t>(st.st_size);
+        void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            ::close(fd);
+            ::madvise(map, size, MADV_SEQUENTIAL);
+            file.map_ = map;
+            file.map_size_ = size;
+            file.view_ = std::string_view(static_cast<const char*>(map), size);
+            TERMINYL_STATS_ADD(bytes_in, size);
+            return file;
+        }
+    }
+
+    try {
+        file.owned_ = read_fd(fd, path);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    file.view_ = file.owned_;
+    return file;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    const bool mapped = other.map_ != nullptr;
+    map_ = std::exchange(other.map_, nullptr);
+    map_size_ = std::exchange(other.map_size_, 0);
+    owned_ = std::move(other.owned_);
+    view_ = mapped ? other.view_ : std::string_view(owned_);
+    other.view_ = {};
+    return *this;
+}
+
+MappedFile::~MappedFile() { release(); }
+
+void MappedFile::release() noexcept {
+    if (map_) ::munmap(map_, map_size_);
+    map_ = nullptr;
+    map_size_ = 0;
 }
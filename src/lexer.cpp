@@ -3,31 +3,21 @@
 #include <cstdio>
 // #include <iostream>
 
-Lexer::Lexer(std::string &source) : source_(source) {}
+Lexer::Lexer(std::string_view source, std::uint64_t first_line)
+    : source_(source), index_(source), first_line_(first_line) {}
 
 bool Lexer::isAtEnd() { return current >= getSource().length(); }
 
-char Lexer::advance() {
-  char c = getSource().at(current++);
-  if (c == '\n') {
-    cur_pos.line++;
-    cur_pos.column = 1;
-  } else {
-    cur_pos.column++;
-  }
-  return c;
-}
+char Lexer::advance() { return getSource()[current++]; }
 
-void Lexer::addToken(TokenType type) {
-  std::string_view text{getSource().data() + start, current - start};
-  SourceSpan span{start_pos, cur_pos};
-  tokens.emplace_back(type, text, span);
+bool Lexer::atLineStart() const {
+  return start == 0 || getSource()[start - 1] == '\n';
 }
 
 char Lexer::peek() {
   if (isAtEnd())
     return '\0';
-  return getSource().at(current);
+  return getSource()[current];
 }
 
 void Lexer::lexToken() {
@@ -65,7 +55,7 @@ void Lexer::lexToken() {
     addToken(NEWLINE);
     break;
   case '=':
-    if (start_pos.column == 1)
+    if (atLineStart())
       heading();
     else
       text();
@@ -77,22 +67,33 @@ void Lexer::lexToken() {
 }
 
 void Lexer::heading() {
-  while (!isAtEnd() && getSource().at(current) == '=')
+  while (!isAtEnd() && getSource()[current] == '=')
     advance();
 
   addToken(TokenType::HEADING_MARK);
   // can determine heading lvl with token.lexeme_.size();
 }
 
-std::vector<Token> Lexer::lexTokens() {
+Token Lexer::next() {
+  start = current;
+  if (isAtEnd())
+    return Token(TokenType::EOF_, getSource().substr(current, 0), current);
+  lexToken();
+  return Token(type_, std::string_view(getSource().data() + start, current - start), start);
+}
+
+TokenBuffer Lexer::lexTokens() {
+  // Tokens tile the source, so the start offset is all a token needs; its
+  // end is where the next one starts
+  TokenBuffer tokens(getSource(), first_line_);
   while (!isAtEnd()) {
     start = current;
-    start_pos = cur_pos;
     lexToken();
+    tokens.push(type_, start);
   }
   
-  tokens.emplace_back(TokenType::EOF_, std::string_view{},
-                      SourceSpan{cur_pos, cur_pos});
+  // Empty, but anchored at the end of the source like every other lexeme
+  tokens.finish();
     /* DEBUG
   for (auto const &t : tokens) {
     std::cout << (int)t.getType() << " '" << t.getLexeme() << "'\n";
@@ -102,10 +103,7 @@ std::vector<Token> Lexer::lexTokens() {
 }
 
 void Lexer::text() {
-  while (peek() != '\n' && !isAtEnd() && peek() != '*' && peek() != '_' &&
-         peek() != '`') {
-    advance();
-  }
+  current = index_.next(current);
 
   addToken(TokenType::TEXT);
 }
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include "line_breaker.hpp"
+#include "compiled_document.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+template <class Words>
+void greedy_breaks(Words words, std::size_t width, std::size_t indent,
+                   std::vector<std::size_t> &breaks) {
+  std::size_t line_len = indent;
+  for (std::size_t k = 0; k < words.size(); ++k) {
+    const Document::Word &w = words[k];
+    if (line_len != indent && line_len + 1 + w.width > width) {
+      breaks.push_back(k);
+      line_len = indent;
+    } else if (line_len != indent && !w.glue) {
+      line_len += 1;
+    }
+    line_len += w.width;
+  }
+}
+
+namespace {
+
+using Cost = std::int64_t;
+
+// Per column past the width; larger than any realistic sum of squared slack
+constexpr Cost kOverflowPenalty = 10'000'000'000;
+constexpr Cost kUnknown = std::numeric_limits<Cost>::max() / 2;
+
+// Breakpoints are word indices 0..n: a line from i to j holds words i..j-1.
+// Its length is indent + end_[j] - start_[i], both non-decreasing, so with a
+// convex cost of that length the matrix cost(i, j) is Monge and SMAWK finds
+// every column minimum in linear time. minima_[j] is the cheapest way to lay
+// out words 0..j-1 and breaks_[j] the start of its last line.
+class OptimalBreaker {
+public:
+  template <class Words>
+  OptimalBreaker(const Words &words, std::size_t width, std::size_t indent)
+      : count_(words.size()), width_(static_cast<Cost>(width)),
+        indent_(static_cast<Cost>(indent)), scratch_(threadScratch()) {
+    const std::size_t n = words.size();
+    scratch_.end.assign(n + 1, 0);
+    scratch_.start.assign(n + 1, 0);
+    scratch_.minima.assign(n + 1, kUnknown);
+    scratch_.breaks.assign(n + 1, 0);
+    scratch_.glue.resize(n);
+    scratch_.buf.clear();
+    scratch_.buf.reserve(4 * (n + 1) + 64);
+    scratch_.minima[0] = 0;
+
+    Cost len = 0;
+    for (std::size_t k = 0; k < n; ++k) {
+      const bool glue = words[k].glue;
+      scratch_.glue[k] = glue;
+      const Cost space = glue ? 0 : 1;
+      scratch_.start[k] = len + space;
+      len += space + static_cast<Cost>(words[k].width);
+      scratch_.end[k + 1] = len;
+    }
+  }
+
+  void solve(std::vector<std::size_t> &breaks) {
+    const std::size_t count = count_;
+    if (count < 2)
+      return;
+
+    // Outer loop of the online algorithm: SMAWK over doubling windows,
+    // restarting from a column whose minimum can no longer improve.
+    std::size_t n = count + 1;
+    std::size_t offset = 0;
+    std::size_t i = 0;
+    for (;;) {
+      const std::size_t r = std::min(n, std::size_t{2} << i);
+      const std::size_t edge = (std::size_t{1} << i) + offset;
+      auto &buf = scratch_.buf;
+      for (std::size_t row = offset; row < edge; ++row)
+        buf.push_back(row);
+      for (std::size_t col = edge; col < r + offset; ++col)
+        buf.push_back(col);
+      smawk(0, edge - offset, edge - offset, r + offset - edge);
+      buf.clear();
+
+      const Cost x = scratch_.minima[r - 1 + offset];
+      bool restarted = false;
+      for (std::size_t j = std::size_t{1} << i; j + 1 < r; ++j) {
+        if (cost(j + offset, r - 1 + offset) <= x) {
+          n -= j;
+          i = 0;
+          offset += j;
+          restarted = true;
+          break;
+        }
+      }
+      if (!restarted) {
+        if (r == n)
+          break;
+        ++i;
+      }
+    }
+
+    // The last line carries no raggedness cost. Where it overflows its cost
+    // is the regular one, so minima[count] already covers those starts and
+    // only the starts that fit (a window of at most `width` words) remain.
+    std::size_t last = scratch_.breaks[count];
+    Cost best = scratch_.minima[count];
+    for (std::size_t k = count; k-- > 0 && length(k, count) <= width_;) {
+      const Cost c = scratch_.minima[k] + lead(k);
+      if (c < best) {
+        best = c;
+        last = k;
+      }
+    }
+
+    const std::size_t first = breaks.size();
+    for (std::size_t k = last; k > 0; k = scratch_.breaks[k])
+      breaks.push_back(k);
+    std::reverse(breaks.begin() + static_cast<std::ptrdiff_t>(first),
+                 breaks.end());
+  }
+
+private:
+  struct Scratch {
+    std::vector<Cost> end;
+    std::vector<Cost> start;
+    std::vector<Cost> minima;
+    std::vector<std::size_t> breaks;
+    std::vector<std::size_t> buf;
+    std::vector<char> glue;
+  };
+
+  // The calling thread's scratch, already grown to its largest paragraph
+  static Scratch &threadScratch() {
+    thread_local Scratch scratch;
+    return scratch;
+  }
+
+  Cost length(std::size_t i, std::size_t j) const {
+    return indent_ + scratch_.end[j] - scratch_.start[i];
+  }
+
+  Cost overflow(Cost len) const { return kOverflowPenalty * (len - width_); }
+
+  // Starting a line with punctuation strands it away from its word
+  Cost lead(std::size_t i) const {
+    return i > 0 && scratch_.glue[i] ? kOverflowPenalty : 0;
+  }
+
+  Cost cost(std::size_t i, std::size_t j) const {
+    const Cost len = length(i, j);
+    const Cost slack = width_ - len;
+    return scratch_.minima[i] + lead(i) +
+           (slack >= 0 ? slack * slack : overflow(len));
+  }
+
+  // Column minima of cost over the rows and columns listed in scratch_.buf
+  // at [rows, rows + nrows) and [cols, cols + ncols). Indices, not pointers:
+  // buf grows while the recursion runs.
+  void smawk(std::size_t rows, std::size_t nrows, std::size_t cols,
+             std::size_t ncols) {
+    auto &buf = scratch_.buf;
+    const std::size_t mark = buf.size();
+
+    // Reduce: at most one candidate row per column survives
+    const std::size_t stack = buf.size();
+    std::size_t depth = 0;
+    for (std::size_t r = 0; r < nrows;) {
+      const std::size_t row = buf[rows + r];
+      if (depth == 0) {
+        buf.push_back(row);
+        ++depth;
+        ++r;
+        continue;
+      }
+      const std::size_t col = buf[cols + depth - 1];
+      if (cost(buf[stack + depth - 1], col) < cost(row, col)) {
+        if (depth < ncols) {
+          buf.push_back(row);
+          ++depth;
+        }
+        ++r;
+      } else {
+        buf.pop_back();
+        --depth;
+      }
+    }
+
+    // Recurse on the odd columns
+    if (ncols > 1) {
+      const std::size_t odd = buf.size();
+      for (std::size_t c = 1; c < ncols; c += 2) {
+        const std::size_t col = buf[cols + c];
+        buf.push_back(col);
+      }
+      smawk(stack, depth, odd, buf.size() - odd);
+    }
+
+    // Even columns: their minima lie between those of their odd neighbours
+    std::size_t r = 0;
+    for (std::size_t c = 0; c < ncols;) {
+      const std::size_t col = buf[cols + c];
+      const std::size_t end =
+          c + 1 < ncols ? scratch_.breaks[buf[cols + c + 1]]
+                        : buf[stack + depth - 1];
+      const std::size_t row = buf[stack + r];
+      const Cost v = cost(row, col);
+      if (v < scratch_.minima[col]) {
+        scratch_.minima[col] = v;
+        scratch_.breaks[col] = row;
+      }
+      if (row < end && r + 1 < depth)
+        ++r;
+      else
+        c += 2;
+    }
+
+    buf.resize(mark);
+  }
+
+  std::size_t count_;
+  Cost width_;
+  Cost indent_;
+  Scratch &scratch_;
+};
+
+} // namespace
+
+template <class Words>
+void optimal_breaks(Words words, std::size_t width, std::size_t indent,
+                    std::vector<std::size_t> &breaks) {
+  OptimalBreaker(words, width, indent).solve(breaks);
+}
+
+template void greedy_breaks(Document::Words, std::size_t, std::size_t,
+                            std::vector<std::size_t> &);
+template void greedy_breaks(CompiledWords, std::size_t, std::size_t,
+                            std::vector<std::size_t> &);
+template void optimal_breaks(Document::Words, std::size_t, std::size_t,
+                             std::vector<std::size_t> &);
+template void optimal_breaks(CompiledWords, std::size_t, std::size_t,
+                             std::vector<std::size_t> &);
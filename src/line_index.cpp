@@ -0,0 +1,23 @@
+#include "line_index.hpp"
+#include <algorithm>
+#include <cstring>
+
+LineIndex::LineIndex(std::string_view source, std::uint64_t first_line) : first_line_(first_line) {
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    for (const char* p = begin; p < end;) {
+        const void* nl = std::memchr(p, '\n', static_cast<std::size_t>(end - p));
+        if (!nl) break;
+        p = static_cast<const char*>(nl);
+        newlines_.push_back(static_cast<std::uint64_t>(p - begin));
+        ++p;
+    }
+}
+
+SourcePos LineIndex::position(std::uint64_t offset) const {
+    // Newlines strictly before `offset`; a newline belongs to the line it ends
+    auto it = std::lower_bound(newlines_.begin(), newlines_.end(), offset);
+    const auto line = static_cast<std::uint64_t>(it - newlines_.begin());
+    const std::uint64_t line_start = line == 0 ? 0 : newlines_[line - 1] + 1;
+    return {first_line_ + line, offset - line_start + 1};
+}
@@ -1,30 +1,368 @@
+#include "batch.hpp"
+#include "compiled_document.hpp"
 #include "emitter.hpp"
+#include "heading_index.hpp"
 #include "io.hpp"
 #include "lexer.hpp"
+#include "output_buffer.hpp"
+#include "pager.hpp"
 #include "parser.hpp"
+#include "pipeline.hpp"
+#include "render_cache.hpp"
+#include "stats.hpp"
+#include "watch.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
+namespace {
 
+struct Options {
+    std::vector<std::string> paths;
+    bool stream = false;
+    bool watch = false;
+    bool pager = false;
+    bool toc = false;
+    std::optional<std::string> section;
+    bool batch = false;
+    bool compile = false;
+    std::string output; // -o: batch directory or compiled file
+    std::size_t jobs = 0; // 0 = not given
+    std::string cache_dir;
+    std::uint64_t cache_size = RenderCache::kDefaultMaxBytes;
+    Style style;
+    std::vector<std::size_t> widths; // --width; empty = not given
+    bool format_given = false;
+    bool stats = false;
+    bool stats_json = false;
+};
+
+std::size_t hardware_jobs() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+int usage() {
+    std::cout << "Usage: terminyl [--stream] [--jobs N] <file>\n"
+                 "       terminyl --watch <file>\n"
+                 "       terminyl --pager <file>\n"
+                 "       terminyl --toc <file> | --section TITLE <file>\n"
+                 "       terminyl --batch -o <dir> [--jobs N] <file>... | -\n"
+                 "       terminyl --compile -o <out.termyc> <file>\n"
+                 "       terminyl --width 80,100,120 -o <out> <file>\n"
+                 "       terminyl -            (stream from stdin)\n"
+                 "\n"
+                 "  --jobs N, -j N   render on N threads (0 = one per core)\n"
+                 "  --width W[,W...] columns to wrap at (default 80; in --watch, the\n"
+                 "                   terminal's). Several widths parse once and write\n"
+                 "                   one output per width, named <out>.<W>.<ext>\n"
+                 "  --wrap=MODE      line breaking: greedy (default) or optimal,\n"
+                 "                   which evens out line lengths across a paragraph\n"
+                 "  --format=FMT     ansi, plain (no escapes, ASCII boxes) or html;\n"
+                 "                   defaults to ansi on a terminal and plain otherwise\n"
+                 "  --stats[=json]   report stage times, counts and sizes on stderr\n"
+                 "                   (needs a build with -DTERMINYL_STATS=ON)\n"
+                 "  --toc            list the headings, indented by level\n"
+                 "  --section TITLE  render only the section under the heading TITLE,\n"
+                 "                   up to the next heading of its level or above\n"
+                 "  --watch          re-render whenever the file changes\n"
+                 "  --pager          page through the output on a terminal, rendering\n"
+                 "                   only what is on screen (q quits)\n"
+                 "  --batch          render many files into -o <dir>; \"-\" reads\n"
+                 "                   the file list from stdin, one path per line\n"
+                 "  --compile        parse once into a .termyc file, which renders\n"
+                 "                   in place wherever a source file is accepted\n"
+                 "  --cache-dir DIR  reuse rendered blocks stored in DIR\n"
+                 "  --cache-size N   cache budget in bytes, K/M/G suffixes (default 256M)\n";
+    return 64;
+}
+
+bool parse_count(const char* s, std::uint64_t& out) {
+    // strtoull would also take leading space and a sign, negating "-1" into 2^64-1
+    if (*s < '0' || *s > '9') return false;
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long long n = std::strtoull(s, &end, 10);
+    if (errno == ERANGE) return false;
+    unsigned shift = 0;
+    switch (*end) {
+    case 'K': case 'k': shift = 10; ++end; break;
+    case 'M': case 'm': shift = 20; ++end; break;
+    case 'G': case 'g': shift = 30; ++end; break;
+    default: break;
+    }
+    if (*end != '\0' || n > std::numeric_limits<std::uint64_t>::max() >> shift) return false;
+    out = static_cast<std::uint64_t>(n) << shift;
+    return true;
+}
+
+bool parse_widths(std::string_view list, std::vector<std::size_t>& out) {
+    out.clear();
+    for (;;) {
+        const std::size_t comma = list.find(',');
+        const std::string item(list.substr(0, comma));
+        std::uint64_t n = 0;
+        if (!parse_count(item.c_str(), n) || n == 0) return false;
+        out.push_back(n);
+        if (comma == std::string_view::npos) return true;
+        list.remove_prefix(comma + 1);
+    }
+}
+
+bool parse_args(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--stream") {
+            opts.stream = true;
+        } else if (arg == "--watch") {
+            opts.watch = true;
+        } else if (arg == "--pager") {
+            opts.pager = true;
+        } else if (arg == "--toc") {
+            opts.toc = true;
+        } else if (arg == "--section") {
+            if (++i == argc) return false;
+            opts.section = argv[i];
+        } else if (arg == "--batch") {
+            opts.batch = true;
+        } else if (arg == "--compile") {
+            opts.compile = true;
+        } else if (arg == "-o") {
+            if (++i == argc) return false;
+            opts.output = argv[i];
+        } else if (arg == "--jobs" || arg == "-j") {
+            std::uint64_t n = 0;
+            if (++i == argc || !parse_count(argv[i], n)) return false;
+            opts.jobs = n != 0 ? n : hardware_jobs();
+        } else if (arg == "--cache-dir") {
+            if (++i == argc) return false;
+            opts.cache_dir = argv[i];
+        } else if (arg == "--cache-size") {
+            if (++i == argc || !parse_count(argv[i], opts.cache_size)) return false;
+        } else if (arg == "--width") {
+            if (++i == argc || !parse_widths(argv[i], opts.widths)) return false;
+            opts.style.width = opts.widths[0];
+        } else if (arg.starts_with("--wrap=")) {
+            std::string_view mode = arg.substr(7);
+            if (mode == "greedy") opts.style.wrap = WrapMode::Greedy;
+            else if (mode == "optimal") opts.style.wrap = WrapMode::Optimal;
+            else return false;
+        } else if (arg.starts_with("--format=")) {
+            std::string_view format = arg.substr(9);
+            if (format == "ansi") opts.style.format = OutputFormat::Ansi;
+            else if (format == "plain") opts.style.format = OutputFormat::Plain;
+            else if (format == "html") opts.style.format = OutputFormat::Html;
+            else return false;
+            opts.format_given = true;
+        } else if (arg == "--stats" || arg == "--stats=json") {
+            opts.stats = true;
+            opts.stats_json = arg == "--stats=json";
+        } else if (arg.starts_with("--")) {
+            return false;
+        } else {
+            opts.paths.emplace_back(arg);
+        }
+    }
+
+    if (opts.batch)
+        return !opts.output.empty() && !opts.paths.empty() && !opts.stream && !opts.watch &&
+               !opts.compile && !opts.pager && !opts.toc && !opts.section;
+    if (opts.compile && (opts.toc || opts.section)) return false;
+    if (opts.compile)
+        return !opts.output.empty() && opts.paths.size() == 1 && !opts.stream && !opts.watch;
+    if (opts.paths.empty() && opts.stream) opts.paths.emplace_back("-");
+    // -o names the outputs of a multi-width render, and only that
+    const bool multi_width = opts.widths.size() > 1;
+    if (opts.paths.size() != 1 || opts.output.empty() == multi_width) return false;
+    // These read the whole input before showing any of it
+    if (opts.pager || opts.toc || opts.section)
+        return !opts.stream && !opts.watch && !multi_width && !(opts.toc && opts.section);
+    if (opts.paths[0] == "-") opts.stream = true;
+    if (opts.watch && opts.stream) return false;
+    if (multi_width && (opts.watch || opts.stream)) return false;
+    return true;
+}
+
+// Escapes only help a terminal; files and pipes get plain text. Batch output
+// always goes to files, so it keeps the ANSI default there.
+void resolve_format(Options& opts) {
+    if (opts.format_given || opts.batch) return;
+    opts.style.format = ::isatty(STDOUT_FILENO) ? OutputFormat::Ansi : OutputFormat::Plain;
+}
+
+const char* batch_extension(OutputFormat format) {
+    switch (format) {
+    case OutputFormat::Plain: return ".txt";
+    case OutputFormat::Html: return ".html";
+    case OutputFormat::Ansi: break;
+    }
+    return ".ansi";
+}
+
+std::vector<std::string> batch_inputs(const Options& opts) {
+    if (opts.paths.size() != 1 || opts.paths[0] != "-") return opts.paths;
+    std::vector<std::string> inputs;
+    for (std::string line; std::getline(std::cin, line);) {
+        if (!line.empty()) inputs.push_back(std::move(line));
+    }
+    return inputs;
+}
+
+// out.txt at width 80 goes to out.80.txt
+std::string width_path(const std::string& output, std::size_t width) {
+    std::filesystem::path p(output);
+    p.replace_extension("." + std::to_string(width) + p.extension().string());
+    return p.string();
+}
+
+void write_widths(const Options& opts, const Emitter& emitter, MappedFile source) {
+    if (CompiledDocument::is_compiled(source.view())) {
+        const CompiledDocument doc(std::move(source));
+        for (std::size_t width : opts.widths) {
+            OutputBuffer out;
+            emitter.with_width(width).render(out, doc);
+            write_file(width_path(opts.output, width), out.str());
+        }
+        return;
+    }
+    const std::vector<std::string> rendered = render_widths(source.view(), emitter, opts.widths);
+    for (std::size_t i = 0; i < rendered.size(); ++i)
+        write_file(width_path(opts.output, opts.widths[i]), rendered[i]);
+}
+
+void stream_input(const std::string& path, OutputBuffer& out, const Emitter& emitter) {
+    if (path == "-") {
+        render_stream(STDIN_FILENO, out, emitter);
+        return;
+    }
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Failed to open file: " + path);
+    try {
+        render_stream(fd, out, emitter);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+}
+
+int run(const Options& opts) {
+    Emitter emitter(opts.style);
+    std::optional<RenderCache> cache;
+    if (!opts.cache_dir.empty()) cache.emplace(opts.cache_dir, opts.cache_size);
+
+    if (opts.batch) {
+        BatchOptions batch;
+        batch.out_dir = opts.output;
+        batch.extension = batch_extension(opts.style.format);
+        batch.jobs = opts.jobs != 0 ? opts.jobs : hardware_jobs();
+        batch.cache = cache ? &*cache : nullptr;
+        batch.widths = opts.widths;
+        return render_batch(batch_inputs(opts), emitter, batch, std::cerr) == 0 ? 0 : 1;
+    }
+
+    const std::string& path = opts.paths[0];
+    if (opts.compile) {
+        MappedFile source = MappedFile::open(path);
+        Lexer lex(source.view());
+        write_file(opts.output, compile_document(Parser(lex).parse()));
+        return 0;
+    }
+
+    OutputBuffer out(STDOUT_FILENO);
+    if (opts.stream) {
+        stream_input(path, out, emitter);
+        return 0;
+    }
+    if (opts.watch) {
+        watch_file(path, emitter, out, opts.widths.empty());
+        return 0;
+    }
+
+    MappedFile source = MappedFile::open(path);
+    if (opts.widths.size() > 1) {
+        write_widths(opts, emitter, std::move(source));
+        return 0;
+    }
+    const bool compiled = CompiledDocument::is_compiled(source.view());
+    std::string_view text = source.view();
+    std::uint64_t first_line = 1;
+    if (opts.toc || opts.section) {
+        if (compiled) throw std::runtime_error("--toc and --section need a source file: " + path);
+        // With a cache the whole index is kept for next time; without, a
+        // section search stops at the section's end
+        std::optional<std::vector<HeadingEntry>> headings;
+        if (cache) headings = cached_headings(path, text, *cache);
+        if (opts.toc) {
+            if (!headings) headings = index_headings(text);
+            for (const HeadingEntry& h : *headings) {
+                out.fill(' ', 2 * static_cast<std::size_t>(std::max(h.level - 1, 0)));
+                out.append(h.title);
+                out.append('\n');
+            }
+            out.flush();
+            return 0;
+        }
+        const std::optional<SectionRange> range = headings
+                                                      ? find_section(*headings, text.size(), *opts.section)
+                                                      : find_section(text, *opts.section);
+        if (!range) throw std::runtime_error("No section titled \"" + *opts.section + "\" in " + path);
+        text = text.substr(range->begin, range->end - range->begin);
+        first_line = range->first_line;
+    }
+    // Off a terminal there is nothing to page, so the output is written as usual
+    if (opts.pager && !compiled && ::isatty(STDOUT_FILENO)) {
+        page_source(text, path, emitter, out, opts.widths.empty());
+        return 0;
+    }
+    if (compiled) {
+        // Already parsed; the cache and worker threads would only add work
+        emitter.render(out, CompiledDocument(std::move(source)));
+    } else if (cache) {
+        render_cached(out, text, emitter, *cache);
+    } else if (opts.jobs > 1) {
+        render_parallel(out, text, emitter, opts.jobs);
+    } else {
+        render_source(out, text, emitter, first_line);
+    }
+    out.flush();
+    return 0;
+}
+
+} // namespace
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cout << "Usage: terminyl [file]\n";
+    Options opts;
+    if (!parse_args(argc, argv, opts)) return usage();
+    resolve_format(opts);
+#ifndef TERMINYL_STATS
+    if (opts.stats) {
+        std::cerr << "terminyl: --stats needs a build with -DTERMINYL_STATS=ON\n";
         return 64;
     }
+#endif
 
+    int status = 0;
     try {
-        std::string source = read_file(argv[1]);
-        Lexer lex(source);
-        auto tokens = lex.lexTokens();
-        auto doc = Parser(std::move(tokens)).parse();
-        
-        Emitter emitter;
-        emitter.render(std::cout, doc);
+        status = run(opts);
     } catch (const std::exception& e) {
         std::cerr << e.what() << "\n";
-        return 1;
+        status = 1;
     }
 
-    return 0;
+#ifdef TERMINYL_STATS
+    if (opts.stats) stats::report(std::cerr, opts.stats_json);
+#endif
+    return status;
 }
@@ -0,0 +1,46 @@
+#include "output_buffer.hpp"
+#include "stats.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+OutputBuffer::OutputBuffer(int fd, std::size_t capacity)
+    : fd_(fd), capacity_(capacity) {
+    buf_.reserve(capacity_);
+}
+
+OutputBuffer::~OutputBuffer() {
+    try {
+        flush();
+    } catch (...) {
+    }
+}
+
+void OutputBuffer::flush() {
+    if (fd_ < 0 || buf_.empty()) return;
+    write_all(buf_);
+    buf_.clear();
+}
+
+void OutputBuffer::spill(std::string_view s) {
+    flush();
+    if (s.size() >= capacity_) {
+        write_all(s);
+        return;
+    }
+    buf_.append(s);
+}
+
+void OutputBuffer::write_all(std::string_view s) {
+    TERMINYL_STATS_ADD(bytes_out, s.size());
+    while (!s.empty()) {
+        ssize_t n = ::write(fd_, s.data(), s.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Failed to write output: ") +
+                                     std::strerror(errno));
+        }
+        s.remove_prefix(static_cast<std::size_t>(n));
+    }
+}
@@ -0,0 +1,366 @@
+#include "pager.hpp"
+#include "output_buffer.hpp"
+#include "pipeline.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef __linux__
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+bool PagedDocument::scanned_all() const {
+    return scanned_ == source_.size() && piece_begin_ == source_.size() && !pieces_.empty();
+}
+
+// Feeds the splitter until at least one more piece is complete or the
+// source is exhausted, in which case the rest becomes the last piece
+void PagedDocument::scan() {
+    const std::size_t before = pieces_.size();
+    while (pieces_.size() == before && scanned_ < source_.size()) {
+        const std::uint64_t base = scanned_;
+        const std::string_view chunk = source_.substr(base, kPieceBytes);
+        splitter_.feed(chunk, [&](std::size_t offset, std::uint64_t next_line) {
+            const std::uint64_t end = base + offset;
+            if (end - piece_begin_ < kPieceBytes) return;
+            pieces_.push_back({piece_begin_, end, piece_line_});
+            piece_begin_ = end;
+            piece_line_ = next_line;
+        });
+        scanned_ += chunk.size();
+    }
+    if (pieces_.size() == before && scanned_ == source_.size() &&
+        (piece_begin_ < source_.size() || pieces_.empty())) {
+        pieces_.push_back({piece_begin_, source_.size(), piece_line_});
+        piece_begin_ = source_.size();
+    }
+}
+
+bool PagedDocument::has(std::size_t i) {
+    while (i >= pieces_.size() && !scanned_all()) scan();
+    return i < pieces_.size();
+}
+
+std::size_t PagedDocument::last() {
+    while (!scanned_all()) scan();
+    return pieces_.size() - 1;
+}
+
+const std::vector<std::string_view>& PagedDocument::lines(std::size_t i) {
+    if (auto it = by_piece_.find(i); it != by_piece_.end()) {
+        cache_.splice(cache_.begin(), cache_, it->second);
+        return cache_.front().lines;
+    }
+
+    const Piece& piece = pieces_[i];
+    OutputBuffer out;
+    render_source(out, source_.substr(piece.begin, piece.end - piece.begin), emitter_,
+                  piece.first_line);
+    cache_.push_front({i, out.take(), {}});
+    Rendered& r = cache_.front();
+    std::string_view rest = r.text;
+    while (!rest.empty()) {
+        const std::size_t nl = rest.find('\n');
+        r.lines.push_back(rest.substr(0, nl));
+        if (nl == std::string_view::npos) break;
+        rest.remove_prefix(nl + 1);
+    }
+    by_piece_[i] = cache_.begin();
+
+    if (cache_.size() > kCachedPieces) {
+        by_piece_.erase(cache_.back().piece);
+        cache_.pop_back();
+    }
+    return r.lines;
+}
+
+void PagedDocument::set_emitter(const Emitter& emitter) {
+    emitter_ = emitter;
+    cache_.clear();
+    by_piece_.clear();
+}
+
+#ifdef __linux__
+
+namespace {
+
+constexpr std::string_view kEnterScreen = "\x1b[?1049h\x1b[?25l\x1b[?7l";
+constexpr std::string_view kLeaveScreen = "\x1b[?7h\x1b[?25h\x1b[?1049l";
+constexpr std::size_t kDefaultRows = 24;
+
+// Puts the terminal in raw mode for as long as it lives
+class RawTerminal {
+public:
+    explicit RawTerminal(int fd) : fd_(fd) {
+        if (::tcgetattr(fd_, &saved_) < 0)
+            throw std::runtime_error(std::string("tcgetattr failed: ") + std::strerror(errno));
+        termios raw = saved_;
+        raw.c_iflag &= ~static_cast<tcflag_t>(ICRNL | IXON);
+        raw.c_lflag &= ~static_cast<tcflag_t>(ICANON | ECHO | ISIG | IEXTEN);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        if (::tcsetattr(fd_, TCSAFLUSH, &raw) < 0)
+            throw std::runtime_error(std::string("tcsetattr failed: ") + std::strerror(errno));
+    }
+    RawTerminal(const RawTerminal&) = delete;
+    RawTerminal& operator=(const RawTerminal&) = delete;
+    ~RawTerminal() { ::tcsetattr(fd_, TCSAFLUSH, &saved_); }
+
+private:
+    int fd_;
+    termios saved_{};
+};
+
+struct Position {
+    std::size_t piece = 0;
+    std::size_t line = 0;
+};
+
+// Pieces can render to no lines at all; these skip over them
+bool next_line(PagedDocument& doc, Position& pos) {
+    if (pos.line + 1 < doc.lines(pos.piece).size()) {
+        ++pos.line;
+        return true;
+    }
+    for (std::size_t i = pos.piece + 1; doc.has(i); ++i) {
+        if (!doc.lines(i).empty()) {
+            pos = {i, 0};
+            return true;
+        }
+    }
+    return false;
+}
+
+bool prev_line(PagedDocument& doc, Position& pos) {
+    if (pos.line > 0) {
+        --pos.line;
+        return true;
+    }
+    for (std::size_t i = pos.piece; i-- > 0;) {
+        if (const std::size_t n = doc.lines(i).size(); n != 0) {
+            pos = {i, n - 1};
+            return true;
+        }
+    }
+    return false;
+}
+
+// Top of the screen that ends with the document's last line
+Position last_page(PagedDocument& doc, std::size_t rows) {
+    Position pos{doc.last(), 0};
+    if (const std::size_t n = doc.lines(pos.piece).size(); n != 0)
+        pos.line = n - 1;
+    else
+        prev_line(doc, pos);
+    for (std::size_t r = 1; r < rows && prev_line(doc, pos);) ++r;
+    return pos;
+}
+
+// Whether a whole screen of lines follows `top`
+bool fills_screen(PagedDocument& doc, Position top, std::size_t rows) {
+    for (std::size_t r = 1; r < rows; ++r)
+        if (!next_line(doc, top)) return false;
+    return true;
+}
+
+class Pager {
+public:
+    Pager(PagedDocument& doc, std::string_view title, OutputBuffer& out)
+        : doc_(doc), title_(title), out_(out) {}
+
+    void resize(std::size_t rows) {
+        // The last row is the status line
+        rows_ = rows > 1 ? rows - 1 : 1;
+        clamp();
+    }
+
+    // Renders with `emitter` from now on. Pieces stay the same, so the top
+    // line keeps its piece and moves to the same fraction of its lines.
+    void reflow(const Emitter& emitter) {
+        const std::size_t before = doc_.lines(top_.piece).size();
+        doc_.set_emitter(emitter);
+        const std::size_t after = doc_.lines(top_.piece).size();
+        top_.line = before == 0 ? 0 : top_.line * after / before;
+        clamp();
+    }
+
+    void down(std::size_t n) {
+        for (; n != 0 && next_line(doc_, top_); --n) {}
+        clamp();
+    }
+
+    void up(std::size_t n) {
+        for (; n != 0 && prev_line(doc_, top_); --n) {}
+    }
+
+    void home() { top_ = {}; }
+    void end() { top_ = last_page(doc_, rows_); }
+    std::size_t page() const { return rows_ > 1 ? rows_ - 1 : 1; }
+
+    void draw() {
+        out_.append("\x1b[H");
+        Position pos = top_;
+        bool more = !doc_.lines(pos.piece).empty() || next_line(doc_, pos);
+        for (std::size_t r = 0; r < rows_; ++r) {
+            if (more) {
+                out_.append(doc_.lines(pos.piece)[pos.line]);
+                more = next_line(doc_, pos);
+            }
+            out_.append("\x1b[K\r\n");
+        }
+        out_.append("\x1b[7m ");
+        out_.append(title_);
+        const std::uint64_t size = doc_.source_size();
+        const std::string where =
+            !more ? " (END) "
+                  : " " + std::to_string(size == 0 ? 100 : doc_.offset(top_.piece) * 100 / size) + "% ";
+        out_.append(where);
+        out_.append("\x1b[0m\x1b[K");
+        out_.flush();
+    }
+
+private:
+    // Scrolling stops once the last line reaches the bottom of the screen
+    void clamp() {
+        if (!fills_screen(doc_, top_, rows_)) {
+            const Position last = last_page(doc_, rows_);
+            if (last.piece < top_.piece || (last.piece == top_.piece && last.line < top_.line))
+                top_ = last;
+        }
+    }
+
+    PagedDocument& doc_;
+    std::string_view title_;
+    OutputBuffer& out_;
+    Position top_;
+    std::size_t rows_ = kDefaultRows - 1;
+};
+
+struct TermSize {
+    std::size_t rows;
+    std::size_t cols;
+};
+
+TermSize terminal_size(int fd) {
+    winsize ws{};
+    if (::ioctl(fd, TIOCGWINSZ, &ws) < 0 || ws.ws_row == 0) return {kDefaultRows, 0};
+    return {ws.ws_row, ws.ws_col};
+}
+
+int resize_signal_fd() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    if (::sigprocmask(SIG_BLOCK, &mask, nullptr) < 0) return -1;
+    return ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+// Applies the keys in `keys`; returns false to quit
+bool handle_keys(Pager& pager, std::string_view keys) {
+    while (!keys.empty()) {
+        if (keys.starts_with("\x1b[") && keys.size() >= 3) {
+            const char k = keys[2];
+            std::size_t len = 3;
+            switch (k) {
+            case 'A': pager.up(1); break;
+            case 'B': pager.down(1); break;
+            case 'H': pager.home(); break;
+            case 'F': pager.end(); break;
+            case '5': pager.up(pager.page()); len = 4; break;
+            case '6': pager.down(pager.page()); len = 4; break;
+            default: break;
+            }
+            keys.remove_prefix(std::min(len, keys.size()));
+            continue;
+        }
+        switch (keys[0]) {
+        case 'q': case 'Q': case '\x03': return false;
+        case 'j': case '\r': case '\n': pager.down(1); break;
+        case 'k': pager.up(1); break;
+        case ' ': case 'f': pager.down(pager.page()); break;
+        case 'b': pager.up(pager.page()); break;
+        case 'g': case '<': pager.home(); break;
+        case 'G': case '>': pager.end(); break;
+        default: break;
+        }
+        keys.remove_prefix(1);
+    }
+    return true;
+}
+
+} // namespace
+
+void page_source(std::string_view source, std::string_view title, const Emitter& emitter,
+                 OutputBuffer& out, bool fit_terminal) {
+    int tty = ::open("/dev/tty", O_RDWR | O_CLOEXEC);
+    if (tty < 0) throw std::runtime_error("--pager needs a terminal to read keys from");
+
+    // Lines are shown out of context, so each must carry its own styles
+    Style style = emitter.getStyle();
+    style.close_styles_per_line = true;
+    TermSize size = terminal_size(STDOUT_FILENO);
+    if (fit_terminal && size.cols != 0) style.width = size.cols;
+    PagedDocument doc(source, Emitter(style));
+
+    const int resize_fd = resize_signal_fd();
+    try {
+        RawTerminal raw(tty);
+        Pager pager(doc, title, out);
+        pager.resize(size.rows);
+        out.append(kEnterScreen);
+
+        pollfd pfds[2] = {{tty, POLLIN, 0}, {resize_fd, POLLIN, 0}};
+        const nfds_t nfds = resize_fd >= 0 ? 2 : 1;
+        for (bool running = true; running;) {
+            pager.draw();
+            if (::poll(pfds, nfds, -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (nfds == 2 && (pfds[1].revents & POLLIN)) {
+                signalfd_siginfo info;
+                while (::read(resize_fd, &info, sizeof info) > 0) {}
+                const TermSize now = terminal_size(STDOUT_FILENO);
+                if (fit_terminal && now.cols != 0 && now.cols != size.cols) {
+                    style.width = now.cols;
+                    pager.reflow(Emitter(style));
+                }
+                size = now;
+                pager.resize(size.rows);
+                out.append("\x1b[2J");
+            }
+            if (pfds[0].revents & POLLIN) {
+                char keys[64];
+                const ssize_t n = ::read(tty, keys, sizeof keys);
+                if (n <= 0) break;
+                running = handle_keys(pager, std::string_view(keys, static_cast<std::size_t>(n)));
+            }
+        }
+        out.append(kLeaveScreen);
+        out.flush();
+    } catch (...) {
+        out.append(kLeaveScreen);
+        out.flush();
+        if (resize_fd >= 0) ::close(resize_fd);
+        ::close(tty);
+        throw;
+    }
+    if (resize_fd >= 0) ::close(resize_fd);
+    ::close(tty);
+}
+
+#else
+
+void page_source(std::string_view, std::string_view, const Emitter&, OutputBuffer&, bool) {
+    throw std::runtime_error("--pager is only supported on Linux");
+}
+
+#endif
@@ -1,12 +1,37 @@
 #include "parser.hpp"
+#include "delimiter.hpp"
+#include "lexer.hpp"
 #include "token_type.hpp"
+#include <algorithm>
 #include <cassert>
 
-Parser::Parser(std::vector<Token> tokens) : tokens_(std::move(tokens)) {}
+Parser::Parser(Lexer &lexer) : lexer_(&lexer) { scratch_.inlines.clear(); }
+
+Parser::Parser(const TokenBuffer &tokens) : buffer_(&tokens) {
+  scratch_.inlines.clear();
+}
+
+Parser::Scratch &Parser::threadScratch() {
+  thread_local Scratch scratch;
+  return scratch;
+}
 
 
 Document Parser::parse() {
   Document doc;
+  parse(doc);
+  return doc;
+}
+
+void Parser::parse(Document &doc) {
+  doc_ = &doc;
+  decided_until_ = 0;
+  fetch();
+  // Token offsets, and so every node range, are relative to this source
+  if (lexer_)
+    doc.set_source(lexer_->getSource(), lexer_->firstLine());
+  else
+    doc.set_source(buffer_->source(), buffer_->first_line());
 
   while (!isAtEnd()) {
     skipBlanks();
@@ -14,7 +39,7 @@ Document Parser::parse() {
 
     doc.add(block());
   }
-  return doc;
+  doc_ = nullptr;
 }
 
 Document::Heading Parser::heading() {
@@ -22,160 +47,259 @@ Document::Heading Parser::heading() {
 
   Document::Heading heading;
   heading.level = static_cast<int>(token.getLexeme().size());
-  heading.span.start = token.span().start;
+  heading.range.begin = token.offset();
 
-  std::string text;
+  std::string_view text;
   if (check(TokenType::TEXT)) {
-    const Token &t = advance();
-    text = std::string(t.getLexeme());
+    text = advance().getLexeme();
   }
 
   if (check(TokenType::NEWLINE))
     advance();
 
-  heading.text = std::move(text);
-  heading.span.end = previous().span().end;
+  heading.text = text;
+  heading.range.end = previous().end();
   return heading;
 }
 
 
 Document::Paragraph Parser::paragraph() {
     Document::Paragraph para;
-    para.span.start = peek().span().start;
+    para.range.begin = peek().offset();
     
-    para.inlines = parseInlines(TokenType::NEWLINE);
+    para.inlines = parseInlines();
+    para.words = doc_->make_words(para.inlines);
     
     // Skip trailing newlines
     while (match(TokenType::NEWLINE)) {}
     
-    para.span.end = previous().span().end;
+    para.range.end = previous().end();
     return para;
 }
 
-// Returns true if paragraph should end
-bool Parser::handleNewlineInParagraph(TextAccumulator& text, bool& consumed_any) {
-    if (!check(TokenType::NEWLINE)) {
-        return false;
-    }
-    
-    // Double newline ends paragraph
-    if (current + 1 < tokens_.size() &&
-        tokens_[current + 1].getType() == TokenType::NEWLINE) {
-        return true;
-    }
-    
-    // Single newline becomes a space
-    const Token &newline = advance();
-    if (text.isEmpty()) {
-        text.append(" ", newline.span().start);
-    } else {
-        text.appendSpace();
-    }
-    consumed_any = true;
-    return false;
+// Inlines are parsed in two passes over a flat list, like CommonMark's
+// delimiter runs: scanInlines reads the paragraph and pairs up `*`/`_`
+// delimiters on a stack (delimiter.hpp says which can open or close), then
+// buildInlines turns the pairs into nodes. Both are iterative and touch every
+// item a bounded number of times, so any input is parsed in linear time
+// without deep recursion.
+Document::Inline::Children Parser::parseInlines() {
+    scanInlines();
+    return buildInlines();
 }
-std::vector<Document::InlinePtr> Parser::parseInlines(TokenType endToken) {
-    std::vector<Document::InlinePtr> inlines;
-    TextAccumulator text;
-    
-    auto flush_text = [&]() {
-        if (!text.isEmpty()) {
-            inlines.push_back(text.flush(previous().span().end));
-        }
-    };
-    
-    while (!isAtEnd() && !check(endToken)) {
-        if (check(TokenType::NEWLINE)) {
-            // Handle double newline ending paragraph
-            if (endToken == TokenType::NEWLINE && 
-                current + 1 < tokens_.size() &&
-                tokens_[current + 1].getType() == TokenType::NEWLINE) {
+
+void Parser::scanInlines() {
+    std::vector<InlineItem> &items = scratch_.items;
+    items.clear();
+    scratch_.openers.clear();
+    // Unmatched openers of each kind, STAR and UNDERSCORE
+    std::size_t open[2] = {0, 0};
+
+    while (!isAtEnd()) {
+        const TokenType type = peek().getType();
+
+        if (type == TokenType::NEWLINE) {
+            // A newline ends the paragraph unless a delimiter open at it
+            // closes before the blank line, which always ends it. One that
+            // never closes is literal and leaves the lines apart.
+            if (scratch_.openers.empty() ||
+                lookahead().getType() == TokenType::NEWLINE ||
+                newlineEndsParagraph(peek().offset(), items.front().range.begin))
                 break;
-            }
-            // Single newline becomes a space
-            advance();
-            text.appendSpace();
-            continue;
-        }
-        
-        if (check(TokenType::STAR)) {
-            flush_text();
-            inlines.push_back(parseBold());
+            const Token &newline = advance();
+            items.push_back({TokenType::NEWLINE, InlineItem::kUnmatched,
+                             newline.getLexeme(),
+                             {newline.offset(), newline.end()}});
             continue;
         }
-        
-        if (check(TokenType::UNDERSCORE)) {
-            flush_text();
-            inlines.push_back(parseItalic());
+
+        if (type == TokenType::STAR || type == TokenType::UNDERSCORE) {
+            matchDelimiter(open);
             continue;
         }
-        
-        if (check(TokenType::BACKTICK)) {
-            flush_text();
-            inlines.push_back(parseCode());
+
+        if (type == TokenType::BACKTICK && codeSpanCloses(peek().offset())) {
+            items.push_back(parseCode());
             continue;
         }
-        
-        // Regular text
+
+        // Regular text, or a backtick that opens nothing
         const Token &token = advance();
-        text.append(token.getLexeme(), token.span().start);
+        items.push_back({TokenType::TEXT, InlineItem::kUnmatched,
+                         token.getLexeme(), {token.offset(), token.end()}});
     }
-    
-    flush_text();
-    return inlines;
 }
 
-Document::InlinePtr Parser::parseBold() {
-    SourceSpan span;
-    span.start = peek().span().start;
-    
-    advance(); // consume opening *
-    
-    // Recursively parse content until closing *
-    auto children = parseInlines(TokenType::STAR);
-    
-    if (check(TokenType::STAR)) {
-        advance(); // consume closing *
+// A delimiter that closes ends the innermost open one of its kind; the
+// openers above it can then never close and stay literal. Otherwise it opens
+// if it can, or is literal. The per-kind counts
+// spare a search down the stack that could not succeed, so every opener is
+// pushed and popped at most once.
+void Parser::matchDelimiter(std::size_t (&open)[2]) {
+    std::vector<InlineItem> &items = scratch_.items;
+    std::vector<std::uint32_t> &openers = scratch_.openers;
+    const Token &token = advance();
+    const TokenType type = token.getType();
+    const auto index = static_cast<std::uint32_t>(items.size());
+    items.push_back({type, InlineItem::kUnmatched, token.getLexeme(),
+                     {token.offset(), token.end()}});
+
+    const std::string_view source = doc_->source();
+    const DelimiterRole role = delimiter_role(
+        token.offset() == 0 ? '\n' : source[token.offset() - 1],
+        token.end() < source.size() ? source[token.end()] : '\n');
+    const std::size_t kind = type == TokenType::UNDERSCORE;
+
+    // One that could go either way nests inside an open delimiter of the
+    // other kind, which is how `*a _b *c d* e_*` is meant
+    const bool closes =
+        role.can_close && open[kind] != 0 &&
+        (!role.can_open || items[openers.back()].type == type);
+    if (closes) {
+        while (items[openers.back()].type != type) {
+            --open[1 - kind];
+            openers.pop_back();
+        }
+        items[openers.back()].match = index;
+        items[index].match = openers.back();
+        openers.pop_back();
+        --open[kind];
+    } else if (role.can_open) {
+        openers.push_back(index);
+        ++open[kind];
     }
-    
-    span.end = previous().span().end;
-    return Document::Inline::make_bold(std::move(children), span);
 }
 
-Document::InlinePtr Parser::parseItalic() {
-    SourceSpan span;
-    span.start = peek().span().start;
-    
-    advance(); // consume opening _
-    
-    auto children = parseInlines(TokenType::UNDERSCORE);
-    
-    if (check(TokenType::UNDERSCORE)) {
-        advance(); // consume closing _
+// A backtick opens a code span only if another one follows before the
+// paragraph's blank line. Tokens tile the source, so the source bytes can be
+// searched directly. A failed search leaves no backtick behind it to start
+// another one, which keeps the scans linear overall.
+bool Parser::codeSpanCloses(std::uint64_t offset) const {
+    const std::string_view rest = doc_->source().substr(offset + 1);
+    for (std::size_t i = rest.find_first_of("`\n"); i != std::string_view::npos;
+         i = rest.find_first_of("`\n", i + 1)) {
+        if (rest[i] == '`')
+            return true;
+        if (i + 1 < rest.size() && rest[i + 1] == '\n')
+            return false;
     }
-    
-    span.end = previous().span().end;
-    return Document::Inline::make_italic(std::move(children), span);
+    return false;
 }
 
-Document::InlinePtr Parser::parseCode() {
-    SourceSpan span;
-    span.start = peek().span().start;
+// Whether the newline at `offset`, with delimiters open, ends the paragraph
+// that starts at `paragraph`. A BlockSplitter run from there to the blank line
+// pairs the delimiters ahead and reports the newlines nothing open at closes
+// across. Its answers hold for every paragraph up to that blank line, so each
+// byte is scanned once more at most.
+bool Parser::newlineEndsParagraph(std::uint64_t offset, std::uint64_t paragraph) {
+  std::vector<std::uint64_t> &breaks = scratch_.breaks;
+  if (offset >= decided_until_) {
+    const std::string_view source = doc_->source();
+    breaks.clear();
+    next_break_ = 0;
+    decided_until_ = source.size();
+    BlockSplitter &splitter = scratch_.splitter;
+    splitter.reset();
+    splitter.feed(source.substr(paragraph), [&](std::size_t end, std::uint64_t) {
+      const std::uint64_t newline = paragraph + end - 1;
+      breaks.push_back(newline);
+      if (newline > offset && source[newline - 1] == '\n') {
+        decided_until_ = newline + 1;
+        return false;
+      }
+      return true;
+    }, true);
+  }
+  while (next_break_ < breaks.size() && breaks[next_break_] < offset)
+    ++next_break_;
+  return next_break_ < breaks.size() && breaks[next_break_] == offset;
+}
+
+Parser::InlineItem Parser::parseCode() {
+    SourceRange range;
+    range.begin = peek().offset();
     advance(); // consume opening `
     
-    // No recursive evaluation inside code blocks
-    std::string content;
+    // No recursive evaluation inside code blocks. Tokens cover the source
+    // without gaps, so the content is the source range they span.
+    std::string_view content;
     while (!isAtEnd() && !check(TokenType::BACKTICK)) {
-        const Token &token = advance();
-        content += token.getLexeme();
+        std::string_view lexeme = advance().getLexeme();
+        content = content.empty()
+                      ? lexeme
+                      : std::string_view(content.data(), lexeme.data() +
+                                                             lexeme.size() -
+                                                             content.data());
     }
     
     if (check(TokenType::BACKTICK)) {
         advance(); // consume closing `
     }
     
-    span.end = previous().span().end;
-    return Document::Inline::make_code(std::move(content), span);
+    range.end = previous().end();
+    return {TokenType::BACKTICK, InlineItem::kUnmatched, content, range};
+}
+
+Document::Inline::Children Parser::buildInlines() {
+    std::vector<Document::InlinePtr> &inlines = scratch_.inlines;
+    std::vector<OpenInline> &open = scratch_.open;
+    TextAccumulator &text = scratch_.text;
+    inlines.clear();
+    open.clear();
+    std::uint64_t text_end = 0;
+
+    auto flush_text = [&]() {
+        if (!text.isEmpty()) {
+            inlines.push_back(text.flush(*doc_, text_end));
+        }
+    };
+
+    const std::vector<InlineItem> &items = scratch_.items;
+    for (std::uint32_t i = 0; i < items.size(); ++i) {
+        const InlineItem &item = items[i];
+        switch (item.type) {
+        case TokenType::NEWLINE:
+            // Inside a paragraph a newline is just a space
+            text.appendSpace();
+            text_end = item.range.end;
+            break;
+        case TokenType::BACKTICK:
+            flush_text();
+            inlines.push_back(doc_->make_code(item.text, item.range));
+            break;
+        case TokenType::STAR:
+        case TokenType::UNDERSCORE:
+            if (item.match == InlineItem::kUnmatched) {
+                // Unmatched delimiters read as the characters they are
+                text.append(item.text, item.range.begin);
+                text_end = item.range.end;
+            } else if (item.match > i) {
+                flush_text();
+                open.push_back({inlines.size(), item.range.begin});
+            } else {
+                flush_text();
+                const OpenInline opener = open.back();
+                open.pop_back();
+                auto children = doc_->make_children(
+                    std::span(inlines).subspan(opener.children));
+                inlines.resize(opener.children);
+                const SourceRange range{opener.begin, item.range.end};
+                inlines.push_back(item.type == TokenType::STAR
+                                      ? doc_->make_bold(children, range)
+                                      : doc_->make_italic(children, range));
+            }
+            break;
+        default:
+            text.append(item.text, item.range.begin);
+            text_end = item.range.end;
+            break;
+        }
+    }
+
+    flush_text();
+    auto children = doc_->make_children(inlines);
+    inlines.clear();
+    return children;
 }
 
 Document::Block Parser::block() {
@@ -184,16 +308,35 @@ Document::Block Parser::block() {
   return paragraph();
 }
 
-const Token &Parser::peek() const { return tokens_.at(current); }
+// Pulls the next token into the ring
+void Parser::fetch() {
+  Token &slot = window_[fetched_ % kWindow];
+  if (lexer_)
+    slot = lexer_->next();
+  else // The EOF token repeats, as it does from the lexer
+    slot = (*buffer_)[std::min(fetched_, buffer_->size() - 1)];
+  ++fetched_;
+}
+
+const Token &Parser::peek() const { return window_[current % kWindow]; }
+
+const Token &Parser::lookahead() {
+  if (fetched_ == current + 1)
+    fetch();
+  return window_[(current + 1) % kWindow];
+}
 
 const Token &Parser::previous() const {
-  assert(current > 0);
-  return tokens_.at(current - 1);
+  assert(current > 0 && current + 1 <= fetched_ + 1);
+  return window_[(current - 1) % kWindow];
 }
 
 const Token &Parser::advance() {
-  if (!isAtEnd())
+  if (!isAtEnd()) {
     current++;
+    if (current == fetched_)
+      fetch();
+  }
   return previous();
 }
 
@@ -0,0 +1,172 @@
+#include "pipeline.hpp"
+#include "block_splitter.hpp"
+#include "emitter.hpp"
+#include "lexer.hpp"
+#include "output_buffer.hpp"
+#include "parser.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+constexpr std::size_t kReadChunk = 64 * 1024;
+constexpr std::size_t kMinParallelChunk = 256 * 1024;
+constexpr std::size_t kMaxParallelChunk = 16 * 1024 * 1024;
+
+struct Chunk {
+  std::size_t begin;
+  std::size_t end;
+  std::uint64_t first_line;
+};
+
+// A few chunks per worker keeps them busy when chunk costs differ
+std::vector<Chunk> split_chunks(std::string_view source, std::size_t jobs) {
+  const std::size_t target = std::clamp(source.size() / (jobs * 4),
+                                        kMinParallelChunk, kMaxParallelChunk);
+  std::vector<Chunk> chunks;
+  BlockSplitter splitter;
+  std::size_t begin = 0;
+  std::uint64_t line = 1;
+  for (std::size_t pos = 0; pos < source.size(); pos += target) {
+    std::size_t cut = splitter.feed(source.substr(pos, target));
+    if (cut == 0)
+      continue;
+    chunks.push_back({begin, pos + cut, line});
+    begin = pos + cut;
+    line = splitter.boundary_line();
+  }
+  if (begin < source.size() || chunks.empty())
+    chunks.push_back({begin, source.size(), line});
+  return chunks;
+}
+} // namespace
+
+void render_source(OutputBuffer &out, std::string_view source,
+                   const Emitter &emitter, std::uint64_t first_line) {
+  Lexer lex(source, first_line);
+#ifdef TERMINYL_STATS
+  // Lexing up front keeps the lex and parse timings apart
+  const TokenBuffer tokens = [&] {
+    TERMINYL_STATS_STAGE(lex);
+    return lex.lexTokens();
+  }();
+  TERMINYL_STATS_TOKENS(tokens);
+  const Document doc = [&] {
+    TERMINYL_STATS_STAGE(parse);
+    return Parser(tokens).parse();
+  }();
+  TERMINYL_STATS_DOCUMENT(doc);
+#else
+  auto doc = Parser(lex).parse();
+#endif
+  TERMINYL_STATS_STAGE(emit);
+  emitter.render(out, doc);
+}
+
+void render_stream(int fd, OutputBuffer &out, const Emitter &emitter) {
+  BlockSplitter splitter;
+  std::string pending;
+  std::uint64_t line = 1;
+
+  for (;;) {
+    const std::size_t old_size = pending.size();
+    pending.resize(old_size + kReadChunk);
+    ssize_t n;
+    {
+      TERMINYL_STATS_STAGE(read);
+      n = ::read(fd, pending.data() + old_size, kReadChunk);
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        pending.resize(old_size);
+        continue;
+      }
+      throw std::runtime_error(std::string("Failed to read input: ") +
+                               std::strerror(errno));
+    }
+    pending.resize(old_size + static_cast<std::size_t>(n));
+    TERMINYL_STATS_ADD(bytes_in, static_cast<std::size_t>(n));
+    if (n == 0)
+      break;
+
+    std::size_t cut =
+        splitter.feed(std::string_view(pending).substr(old_size));
+    if (cut == 0)
+      continue;
+
+    cut += old_size;
+    render_source(out, std::string_view(pending).substr(0, cut), emitter,
+                  line);
+    out.flush();
+    line = splitter.boundary_line();
+    pending.erase(0, cut);
+  }
+
+  render_source(out, pending, emitter, line);
+  out.flush();
+}
+
+void render_parallel(OutputBuffer &out, std::string_view source,
+                     const Emitter &emitter, std::size_t jobs) {
+  jobs = std::max<std::size_t>(jobs, 1);
+  const std::vector<Chunk> chunks = split_chunks(source, jobs);
+  if (jobs == 1 || chunks.size() == 1) {
+    render_source(out, source, emitter);
+    return;
+  }
+
+  std::vector<std::string> rendered(chunks.size());
+  std::vector<std::promise<void>> done(chunks.size());
+  std::vector<std::future<void>> ready;
+  ready.reserve(chunks.size());
+  for (auto &d : done)
+    ready.push_back(d.get_future());
+
+  ThreadPool pool(std::min(jobs, chunks.size()));
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    pool.submit([&, i] {
+      try {
+        const Chunk &c = chunks[i];
+        OutputBuffer chunk_out;
+        chunk_out.reserve(c.end - c.begin + (c.end - c.begin) / 4);
+        render_source(chunk_out, source.substr(c.begin, c.end - c.begin),
+                      emitter, c.first_line);
+        rendered[i] = chunk_out.take();
+        done[i].set_value();
+      } catch (...) {
+        done[i].set_exception(std::current_exception());
+      }
+    });
+  }
+
+  // Write in order as soon as each prefix is ready
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    ready[i].get();
+    out.append(rendered[i]);
+    std::string().swap(rendered[i]);
+  }
+  pool.wait();
+}
+
+std::vector<std::string> render_widths(std::string_view source,
+                                       const Emitter &emitter,
+                                       std::span<const std::size_t> widths) {
+  Lexer lex(source);
+  const Document doc = Parser(lex).parse();
+  std::vector<std::string> rendered;
+  rendered.reserve(widths.size());
+  for (std::size_t width : widths) {
+    OutputBuffer out;
+    out.reserve(source.size() + source.size() / 4 + 256);
+    emitter.with_width(width).render(out, doc);
+    rendered.push_back(out.take());
+  }
+  return rendered;
+}
@@ -0,0 +1,198 @@
+#include "render_cache.hpp"
+#include "block_splitter.hpp"
+#include "emitter.hpp"
+#include "hash.hpp"
+#include "output_buffer.hpp"
+#include "pipeline.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Bump whenever the emitter's output for the same input changes
+constexpr std::uint64_t kCacheFormatVersion = 5;
+constexpr std::uint64_t kSeedHi = 0x7465726d696e796cULL;
+constexpr std::uint64_t kSeedLo = 0x626c6f636b636163ULL;
+// Evict down to this fraction of the budget so we do not evict on every run
+constexpr double kEvictTarget = 0.9;
+
+std::string hex(std::uint64_t v) {
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string out(16, '0');
+    for (int i = 15; i >= 0; --i, v >>= 4) out[static_cast<std::size_t>(i)] = digits[v & 0xf];
+    return out;
+}
+
+bool read_all(int fd, std::string& out) {
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) return false;
+    out.resize(static_cast<std::size_t>(st.st_size));
+    std::size_t done = 0;
+    while (done < out.size()) {
+        ssize_t n = ::read(fd, out.data() + done, out.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool write_all(int fd, std::string_view s) {
+    while (!s.empty()) {
+        ssize_t n = ::write(fd, s.data(), s.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        s.remove_prefix(static_cast<std::size_t>(n));
+    }
+    return true;
+}
+
+} // namespace
+
+RenderCache::RenderCache(fs::path dir, std::uint64_t max_bytes)
+    : dir_(std::move(dir)), max_bytes_(max_bytes) {
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (ec) throw std::runtime_error("Failed to create cache directory: " + dir_.string());
+}
+
+RenderCache::~RenderCache() {
+    if (stored_bytes_ == 0) return;
+    try {
+        evict();
+    } catch (...) {
+    }
+}
+
+RenderCache::Key RenderCache::key_for(std::string_view source, const Emitter& emitter) {
+    const Style& style = emitter.getStyle();
+    std::uint64_t settings = hash_detail::mix(kCacheFormatVersion ^ hash_detail::kP0,
+                                              style.width ^ hash_detail::kP1);
+    settings = hash_detail::mix(settings, style.paragraph_indent ^ hash_detail::kP2);
+    settings = hash_detail::mix(settings, static_cast<std::uint64_t>(style.wrap) ^ hash_detail::kP0);
+    settings = hash_detail::mix(settings, static_cast<std::uint64_t>(style.format) ^ hash_detail::kP1);
+    settings = hash_detail::mix(settings,
+                                static_cast<std::uint64_t>(style.close_styles_per_line) ^ hash_detail::kP2);
+    return {hash_bytes(source, kSeedHi ^ settings), hash_bytes(source, kSeedLo + settings)};
+}
+
+fs::path RenderCache::path_for(const Key& key) const {
+    std::string name = hex(key.hi);
+    return dir_ / name.substr(0, 2) / (name.substr(2) + hex(key.lo));
+}
+
+std::optional<std::string> RenderCache::load(const Key& key) {
+    const fs::path path = path_for(key);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ++misses_;
+        return std::nullopt;
+    }
+    std::string out;
+    bool ok = read_all(fd, out);
+    // Recency for eviction; failure only makes the entry look older
+    ::futimens(fd, nullptr);
+    ::close(fd);
+    if (!ok) {
+        ++misses_;
+        return std::nullopt;
+    }
+    ++hits_;
+    return out;
+}
+
+void RenderCache::store(const Key& key, std::string_view rendered) {
+    static std::atomic<unsigned> counter{0};
+    const fs::path path = path_for(key);
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    if (ec) return;
+
+    // Unique per process and call, renamed over the final name atomically
+    fs::path tmp = path.parent_path() /
+                   (".tmp." + std::to_string(::getpid()) + "." + std::to_string(counter++));
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    bool ok = write_all(fd, rendered);
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return;
+    }
+    stored_bytes_ += rendered.size();
+}
+
+void RenderCache::evict() {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type mtime;
+        std::uint64_t size;
+    };
+    std::vector<Entry> entries;
+    std::uint64_t total = 0;
+
+    // Other processes may add or evict concurrently; vanished files are fine
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(dir_, ec);
+         !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        std::error_code fec;
+        if (!it->is_regular_file(fec)) continue;
+        auto size = it->file_size(fec);
+        if (fec) continue;
+        auto mtime = it->last_write_time(fec);
+        if (fec) continue;
+        entries.push_back({it->path(), mtime, size});
+        total += size;
+    }
+    if (total <= max_bytes_) return;
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.mtime < b.mtime; });
+    const auto target = static_cast<std::uint64_t>(static_cast<double>(max_bytes_) * kEvictTarget);
+    for (const Entry& e : entries) {
+        if (total <= target) break;
+        std::error_code rec;
+        fs::remove(e.path, rec);
+        total -= e.size;
+    }
+}
+
+void render_cached(OutputBuffer& out, std::string_view source,
+                   const Emitter& emitter, RenderCache& cache) {
+    // Cache at blank-line granularity: one entry per paragraph or heading
+    // group, rather than one tiny file per line
+    std::size_t begin = 0;
+    std::uint64_t line = 1;
+    auto emit_segment = [&](std::size_t end, std::uint64_t next_line) {
+        std::string_view text = source.substr(begin, end - begin);
+        if (text.find_first_not_of('\n') == std::string_view::npos) {
+            // Blank lines render to nothing, not worth a lookup
+        } else {
+            const RenderCache::Key key = RenderCache::key_for(text, emitter);
+            if (auto hit = cache.load(key)) {
+                out.append(*hit);
+            } else {
+                OutputBuffer block;
+                render_source(block, text, emitter, line);
+                cache.store(key, block.str());
+                out.append(block.str());
+            }
+        }
+        begin = end;
+        line = next_line;
+    };
+
+    BlockSplitter splitter;
+    splitter.feed(source, [&](std::size_t end, std::uint64_t next_line) {
+        if (end >= 2 && source[end - 2] == '\n') emit_segment(end, next_line);
+    });
+    if (begin < source.size()) emit_segment(source.size(), line);
+}
@@ -0,0 +1,21 @@
+#include "render_context.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+
+void RenderContext::render(std::string_view source, OutputBuffer& out) {
+    doc_.reset();
+    Lexer lex(source);
+    Parser(lex).parse(doc_);
+    emitter_.render(out, doc_);
+}
+
+std::string_view RenderContext::render(std::string_view source) {
+    out_.clear();
+    render(source, out_);
+    return out_.str();
+}
+
+void RenderContext::reset() {
+    doc_.reset();
+    out_.clear();
+}
@@ -0,0 +1,161 @@
+#include "stats.hpp"
+
+#ifdef TERMINYL_STATS
+
+#include "document.hpp"
+#include "token_buffer.hpp"
+#include <cstdio>
+#include <ctime>
+#include <ostream>
+#include <string_view>
+#include <sys/resource.h>
+#include <variant>
+#include <vector>
+
+namespace stats {
+
+namespace {
+
+constexpr std::string_view kStageNames[kStages] = {"read", "lex", "parse",
+                                                   "emit"};
+
+// In TokenType order
+constexpr std::string_view kTokenNames[kTokenTypes] = {
+    "NEWLINE", "HASH",       "EQUAL",        "LEFT_PAREN", "RIGHT_PAREN",
+    "LEFT_SQ_BRACKET",       "RIGHT_SQ_BRACKET",           "COLON",
+    "COMMA",   "STRING",     "IDENTIFIER",   "TEXT",       "HEADING_MARK",
+    "STAR",    "BACKTICK",   "UNDERSCORE",   "EOF"};
+
+constexpr std::string_view kInlineNames[kInlineKinds] = {"text", "bold",
+                                                         "italic", "code"};
+
+static_assert(std::variant_size_v<decltype(Document::Inline::node)> ==
+              kInlineKinds);
+
+std::uint64_t now_ns(clockid_t clock) {
+  timespec ts{};
+  ::clock_gettime(clock, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000u +
+         static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+std::uint64_t load(const Counter &c) {
+  return c.load(std::memory_order_relaxed);
+}
+
+void count_inlines(Document::Inline::Children children) {
+  // Explicit stack, as nesting depth is bounded only by the input
+  std::vector<Document::InlinePtr> pending(children.begin(), children.end());
+  while (!pending.empty()) {
+    Document::InlinePtr n = pending.back();
+    pending.pop_back();
+    counters().inlines[n->node.index()].fetch_add(1, std::memory_order_relaxed);
+    Document::Inline::Children nested;
+    if (auto *b = std::get_if<Document::Inline::Bold>(&n->node))
+      nested = b->children;
+    else if (auto *i = std::get_if<Document::Inline::Italic>(&n->node))
+      nested = i->children;
+    pending.insert(pending.end(), nested.begin(), nested.end());
+  }
+}
+
+std::uint64_t peak_rss_bytes() {
+  rusage usage{};
+  ::getrusage(RUSAGE_SELF, &usage);
+  // Linux reports kilobytes
+  return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+double ms(std::uint64_t ns) { return static_cast<double>(ns) / 1e6; }
+
+} // namespace
+
+Counters &counters() {
+  static Counters c;
+  return c;
+}
+
+StageTimer::StageTimer(Stage stage)
+    : stage_(stage), wall_start_(now_ns(CLOCK_MONOTONIC)),
+      cpu_start_(now_ns(CLOCK_THREAD_CPUTIME_ID)) {}
+
+StageTimer::~StageTimer() {
+  const auto i = static_cast<std::size_t>(stage_);
+  counters().wall_ns[i].fetch_add(now_ns(CLOCK_MONOTONIC) - wall_start_,
+                                  std::memory_order_relaxed);
+  counters().cpu_ns[i].fetch_add(now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start_,
+                                 std::memory_order_relaxed);
+}
+
+void count_tokens(const TokenBuffer &tokens) {
+  // The EOF sentinel is part of size()
+  for (std::size_t i = 0; i < tokens.size(); ++i)
+    counters()
+        .tokens[static_cast<std::size_t>(tokens.type(i))]
+        .fetch_add(1, std::memory_order_relaxed);
+}
+
+void count_document(const Document &doc) {
+  for (const auto &blk : doc.blocks()) {
+    if (auto *p = std::get_if<Document::Paragraph>(&blk)) {
+      counters().paragraphs.fetch_add(1, std::memory_order_relaxed);
+      count_inlines(p->inlines);
+    } else {
+      counters().headings.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+void report(std::ostream &out, bool json) {
+  const Counters &c = counters();
+  const std::uint64_t rss = peak_rss_bytes();
+
+  if (json) {
+    out << "{\"stages\": {";
+    for (std::size_t i = 0; i < kStages; ++i)
+      out << (i ? ", " : "") << '"' << kStageNames[i]
+          << "\": {\"wall_ms\": " << ms(load(c.wall_ns[i]))
+          << ", \"cpu_ms\": " << ms(load(c.cpu_ns[i])) << '}';
+    out << "}, \"tokens\": {";
+    for (std::size_t i = 0; i < kTokenTypes; ++i)
+      out << (i ? ", " : "") << '"' << kTokenNames[i]
+          << "\": " << load(c.tokens[i]);
+    out << "}, \"inlines\": {";
+    for (std::size_t i = 0; i < kInlineKinds; ++i)
+      out << (i ? ", " : "") << '"' << kInlineNames[i]
+          << "\": " << load(c.inlines[i]);
+    out << "}, \"blocks\": {\"heading\": " << load(c.headings)
+        << ", \"paragraph\": " << load(c.paragraphs) << '}'
+        << ", \"bytes_in\": " << load(c.bytes_in)
+        << ", \"bytes_out\": " << load(c.bytes_out)
+        << ", \"escape_bytes\": " << load(c.escape_bytes)
+        << ", \"peak_rss_bytes\": " << rss << "}\n";
+    return;
+  }
+
+  out << "stage       wall ms     cpu ms\n";
+  for (std::size_t i = 0; i < kStages; ++i) {
+    char line[64];
+    std::snprintf(line, sizeof line, "%-8s %10.3f %10.3f\n",
+                  kStageNames[i].data(), ms(load(c.wall_ns[i])),
+                  ms(load(c.cpu_ns[i])));
+    out << line;
+  }
+  out << "tokens:";
+  for (std::size_t i = 0; i < kTokenTypes; ++i)
+    if (load(c.tokens[i]) != 0)
+      out << ' ' << kTokenNames[i] << '=' << load(c.tokens[i]);
+  out << "\ninlines:";
+  for (std::size_t i = 0; i < kInlineKinds; ++i)
+    out << ' ' << kInlineNames[i] << '=' << load(c.inlines[i]);
+  out << "\nblocks: heading=" << load(c.headings)
+      << " paragraph=" << load(c.paragraphs) << '\n'
+      << "bytes in: " << load(c.bytes_in) << '\n'
+      << "bytes out: " << load(c.bytes_out) << '\n'
+      << "escape bytes: " << load(c.escape_bytes) << '\n'
+      << "peak RSS: " << rss << '\n';
+}
+
+} // namespace stats
+
+#endif
@@ -0,0 +1,106 @@
+#include "structural_index.hpp"
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TERMINYL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr std::size_t kBlock = 64;
+
+using Kernel = std::uint64_t (*)(const char *);
+
+std::uint64_t classify_scalar(const char *p) {
+  std::uint64_t mask = 0;
+  for (std::size_t i = 0; i < kBlock; ++i) {
+    char c = p[i];
+    if (c == '\n' || c == '*' || c == '_' || c == '`')
+      mask |= std::uint64_t{1} << i;
+  }
+  return mask;
+}
+
+#ifdef TERMINYL_X86
+__attribute__((target("sse2"))) std::uint32_t classify16_sse2(const char *p) {
+  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  __m128i m = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('*'))),
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('`'))));
+  return static_cast<std::uint32_t>(_mm_movemask_epi8(m));
+}
+
+__attribute__((target("sse2"))) std::uint64_t classify_sse2(const char *p) {
+  return std::uint64_t{classify16_sse2(p)} |
+         std::uint64_t{classify16_sse2(p + 16)} << 16 |
+         std::uint64_t{classify16_sse2(p + 32)} << 32 |
+         std::uint64_t{classify16_sse2(p + 48)} << 48;
+}
+
+__attribute__((target("avx2"))) std::uint32_t classify32_avx2(const char *p) {
+  __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  __m256i m = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('*'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('`'))));
+  return static_cast<std::uint32_t>(_mm256_movemask_epi8(m));
+}
+
+__attribute__((target("avx2"))) std::uint64_t classify_avx2(const char *p) {
+  return std::uint64_t{classify32_avx2(p)} |
+         std::uint64_t{classify32_avx2(p + 32)} << 32;
+}
+#endif
+
+struct Dispatch {
+  Kernel kernel;
+  const char *name;
+};
+
+Dispatch pick_kernel() {
+#ifdef TERMINYL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return {classify_avx2, "avx2"};
+  if (__builtin_cpu_supports("sse2"))
+    return {classify_sse2, "sse2"};
+#endif
+  return {classify_scalar, "scalar"};
+}
+
+const Dispatch kDispatch = pick_kernel();
+
+} // namespace
+
+const char *StructuralIndex::kernel_name() { return kDispatch.name; }
+
+void StructuralIndex::load(std::size_t block) {
+  block_ = block;
+  if (block + kBlock <= source_.size()) {
+    mask_ = kDispatch.kernel(source_.data() + block);
+    return;
+  }
+  // Tail: pad with bytes that are never structural
+  char buf[kBlock] = {};
+  std::memcpy(buf, source_.data() + block, source_.size() - block);
+  mask_ = kDispatch.kernel(buf);
+}
+
+std::size_t StructuralIndex::next(std::size_t pos) {
+  const std::size_t size = source_.size();
+  while (pos < size) {
+    std::size_t block = pos & ~(kBlock - 1);
+    if (block != block_)
+      load(block);
+    std::uint64_t m = mask_ >> (pos - block);
+    if (m != 0)
+      return pos + static_cast<std::size_t>(std::countr_zero(m));
+    pos = block + kBlock;
+  }
+  return size;
+}
@@ -0,0 +1,137 @@
+#include "style_state.hpp"
+#include <array>
+#include <cstddef>
+
+namespace {
+
+struct Attribute {
+  unsigned bit;
+  const char *on;
+  const char *off;
+};
+
+// In bits() order
+constexpr Attribute kAttributes[] = {
+    {1, "1", "22"}, {2, "3", "23"}, {4, "7", "27"}, {8, "4", "24"}};
+
+// Long enough for every attribute switched off and on again
+constexpr std::size_t kMaxSequence = 24;
+constexpr std::size_t kMaxTags = 48;
+
+template <std::size_t N> struct Bytes {
+  std::array<char, N> bytes{};
+  std::size_t size = 0;
+
+  constexpr void append(const char *s) {
+    while (*s != '\0')
+      bytes[size++] = *s++;
+  }
+};
+
+struct Sequence : Bytes<kMaxSequence> {
+  constexpr void parameter(const char *code) {
+    append(size == 2 ? "" : ";");
+    append(code);
+  }
+};
+
+// Either "off" and "on" codes for just the attributes that differ, or a
+// reset followed by every attribute of `to`, whichever is shorter
+constexpr Sequence make_transition(unsigned from, unsigned to) {
+  Sequence seq;
+  if (from == to)
+    return seq;
+
+  Sequence delta;
+  delta.append("\x1b[");
+  for (const Attribute &a : kAttributes) {
+    if ((from & a.bit) && !(to & a.bit))
+      delta.parameter(a.off);
+    else if (!(from & a.bit) && (to & a.bit))
+      delta.parameter(a.on);
+  }
+  delta.append("m");
+
+  Sequence reset;
+  reset.append("\x1b[0");
+  for (const Attribute &a : kAttributes) {
+    if (to & a.bit) {
+      reset.append(";");
+      reset.append(a.on);
+    }
+  }
+  reset.append("m");
+
+  return delta.size <= reset.size ? delta : reset;
+}
+
+// HTML elements nest, so they are kept open in bits() order, outermost
+// first. From the first attribute that differs on, the open ones are closed
+// innermost first and the wanted ones opened again.
+constexpr const char *kTags[] = {"strong", "em", "code", "u"};
+
+using Tags = Bytes<kMaxTags>;
+
+constexpr Tags make_tags(unsigned from, unsigned to) {
+  Tags tags;
+  constexpr int n = static_cast<int>(std::size(kTags));
+  int first = 0;
+  while (first < n && ((from ^ to) & (1u << first)) == 0)
+    ++first;
+  for (int i = n - 1; i >= first; --i) {
+    if (from & (1u << i)) {
+      tags.append("</");
+      tags.append(kTags[i]);
+      tags.append(">");
+    }
+  }
+  for (int i = first; i < n; ++i) {
+    if (to & (1u << i)) {
+      tags.append("<");
+      tags.append(kTags[i]);
+      tags.append(">");
+    }
+  }
+  return tags;
+}
+
+template <class T>
+using Table = std::array<std::array<T, StyleState::kCombinations>,
+                         StyleState::kCombinations>;
+
+template <class T, T (*Make)(unsigned, unsigned)>
+constexpr Table<T> make_table() {
+  Table<T> t{};
+  for (unsigned from = 0; from < StyleState::kCombinations; ++from)
+    for (unsigned to = 0; to < StyleState::kCombinations; ++to)
+      t[from][to] = Make(from, to);
+  return t;
+}
+
+constexpr Table<Sequence> kTransitions = make_table<Sequence, make_transition>();
+constexpr Table<Tags> kTagTransitions = make_table<Tags, make_tags>();
+
+template <std::size_t N> constexpr std::string_view view(const Bytes<N> &s) {
+  return {s.bytes.data(), s.size};
+}
+
+static_assert(view(kTransitions[0][1]) == "\x1b[1m");
+static_assert(view(kTransitions[1][0]) == "\x1b[0m");
+static_assert(view(kTransitions[1][2]) == "\x1b[0;3m");
+static_assert(view(kTransitions[3][7]) == "\x1b[7m");
+static_assert(view(kTransitions[7][3]) == "\x1b[27m");
+static_assert(view(kTransitions[3][3]).empty());
+static_assert(view(kTagTransitions[0][5]) == "<strong><code>");
+static_assert(view(kTagTransitions[5][1]) == "</code>");
+static_assert(view(kTagTransitions[3][5]) == "</em><code>");
+static_assert(view(kTagTransitions[3][2]) == "</em></strong><em>");
+
+} // namespace
+
+std::string_view sgr_transition(StyleState from, StyleState to) {
+  return view(kTransitions[from.bits()][to.bits()]);
+}
+
+std::string_view html_transition(StyleState from, StyleState to) {
+  return view(kTagTransitions[from.bits()][to.bits()]);
+}
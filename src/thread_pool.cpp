@@ -0,0 +1,118 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace {
+thread_local const ThreadPool *tls_pool = nullptr;
+thread_local std::size_t tls_index = 0;
+}
+
+ThreadPool::ThreadPool(std::size_t workers) {
+    workers = std::max<std::size_t>(workers, 1);
+    for (std::size_t i = 0; i < workers; ++i)
+        queues_.push_back(std::make_unique<Queue>());
+    threads_.reserve(workers);
+    try {
+        for (std::size_t i = 0; i < workers; ++i)
+            threads_.emplace_back([this, i] { run(i); });
+    } catch (...) {
+        // The destructor won't run, and joinable threads must not be destroyed
+        shutdown();
+        throw;
+    }
+}
+
+ThreadPool::~ThreadPool() { shutdown(); }
+
+void ThreadPool::shutdown() {
+    {
+        std::lock_guard lock(state_m_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto &t : threads_)
+        t.join();
+}
+
+std::size_t ThreadPool::worker_index() const {
+    return tls_pool == this ? tls_index : size();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    std::size_t q = worker_index();
+    if (q == size())
+        q = next_queue_.fetch_add(1, std::memory_order_relaxed) % size();
+    {
+        std::lock_guard lock(queues_[q]->m);
+        queues_[q]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(state_m_);
+        ++queued_;
+        ++unfinished_;
+    }
+    work_cv_.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock lock(state_m_);
+    idle_cv_.wait(lock, [this] { return unfinished_ == 0; });
+    if (error_)
+        std::rethrow_exception(std::exchange(error_, nullptr));
+}
+
+bool ThreadPool::try_take(std::size_t self, std::function<void()> &task) {
+    {
+        Queue &own = *queues_[self];
+        std::lock_guard lock(own.m);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (std::size_t k = 1; k < queues_.size(); ++k) {
+        Queue &victim = *queues_[(self + k) % queues_.size()];
+        std::lock_guard lock(victim.m);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(std::size_t self) {
+    tls_pool = this;
+    tls_index = self;
+
+    std::function<void()> task;
+    for (;;) {
+        {
+            // Claiming a task under the lock guarantees one is waiting in
+            // some queue for us, so the scan below cannot come up empty
+            std::unique_lock lock(state_m_);
+            work_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+            if (queued_ == 0)
+                return;
+            --queued_;
+        }
+        while (!try_take(self, task)) {
+        }
+
+        std::exception_ptr err;
+        try {
+            task();
+        } catch (...) {
+            err = std::current_exception();
+        }
+        task = nullptr;
+
+        std::lock_guard lock(state_m_);
+        if (err && !error_)
+            error_ = err;
+        if (--unfinished_ == 0)
+            idle_cv_.notify_all();
+    }
+}
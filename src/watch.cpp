@@ -0,0 +1,267 @@
+#include "watch.hpp"
+#include "block_splitter.hpp"
+#include "io.hpp"
+#include "lexer.hpp"
+#include "output_buffer.hpp"
+#include "parser.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr std::size_t kCompareStep = 4096;
+
+std::size_t common_prefix(std::string_view a, std::string_view b) {
+    const std::size_t n = std::min(a.size(), b.size());
+    std::size_t i = 0;
+    while (i + kCompareStep <= n && std::memcmp(a.data() + i, b.data() + i, kCompareStep) == 0)
+        i += kCompareStep;
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+std::size_t common_suffix(std::string_view a, std::string_view b) {
+    const std::size_t n = std::min(a.size(), b.size());
+    std::size_t i = 0;
+    while (i + kCompareStep <= n &&
+           std::memcmp(a.data() + a.size() - i - kCompareStep,
+                       b.data() + b.size() - i - kCompareStep, kCompareStep) == 0)
+        i += kCompareStep;
+    while (i < n && a[a.size() - i - 1] == b[b.size() - i - 1]) ++i;
+    return i;
+}
+
+// A blank line ends every block and resets the parser, whatever follows
+bool after_blank_line(std::string_view text, std::size_t pos) {
+    return pos == 0 || (pos >= 2 && text[pos - 1] == '\n' && text[pos - 2] == '\n');
+}
+
+} // namespace
+
+void IncrementalRenderer::render_block(std::string_view text, std::uint64_t line,
+                                       OutputBuffer& out) {
+    doc_.reset();
+    Lexer lex(text, line);
+    Parser(lex).parse(doc_);
+    emitter_.render(out, doc_);
+}
+
+void IncrementalRenderer::render(std::string_view source, OutputBuffer& out) {
+    const std::string_view old = source_;
+    // Only old[first, old.size() - tail) was replaced
+    const std::size_t first = common_prefix(old, source);
+    const std::size_t tail = common_suffix(old.substr(first), source.substr(first));
+    if (!blocks_.empty() && first == old.size() && first == source.size()) {
+        reused_ = blocks_.size();
+        rendered_ = 0;
+        out.append(output_);
+        return;
+    }
+
+    // Old blocks [s, t) are replaced by `window`, split from the last blank
+    // line before the change to the first one after it in the shared suffix
+    std::size_t s = static_cast<std::size_t>(
+        std::upper_bound(blocks_.begin(), blocks_.end(), first,
+                         [](std::size_t pos, const Block& b) { return pos < b.end; }) -
+        blocks_.begin());
+    while (s > 0 && !after_blank_line(old, block_begin(s))) --s;
+    std::size_t t = blocks_.size();
+
+    const std::size_t start = block_begin(s);
+    const std::uint64_t start_line = first_line(s);
+    const std::size_t shared_from = source.size() - tail;
+    std::vector<Block> window;
+    OutputBuffer rendered;
+    std::size_t begin = start;
+    std::uint64_t line = start_line;
+    auto add_block = [&](std::size_t end, std::uint64_t next_line) {
+        render_block(source.substr(begin, end - begin), line, rendered);
+        window.push_back({end, rendered.size(), next_line});
+        begin = end;
+        line = next_line;
+    };
+
+    BlockSplitter splitter;
+    splitter.feed(source.substr(start), [&](std::size_t cut, std::uint64_t next_line) {
+        const std::size_t end = start + cut;
+        add_block(end, start_line - 1 + next_line);
+        if (end < shared_from + 2 || !after_blank_line(source, end)) return true;
+        // The old source has the same blank line here, so from it on the old
+        // blocks are the new ones
+        const std::size_t old_end = end + old.size() - source.size();
+        auto it = std::lower_bound(blocks_.begin(), blocks_.end(), old_end,
+                                   [](const Block& b, std::size_t pos) { return b.end < pos; });
+        if (it == blocks_.end() || it->end != old_end) return true;
+        t = static_cast<std::size_t>(it - blocks_.begin()) + 1;
+        return false;
+    }, true);
+    if (t == blocks_.size() && begin < source.size()) add_block(source.size(), line);
+
+    // Shift the blocks after the window to the new offsets, then splice
+    const std::size_t old_output_begin = output_begin(s);
+    const std::size_t old_output_end = output_begin(t);
+    const std::uint64_t old_line = first_line(t);
+    for (Block& b : window) b.output_end += old_output_begin;
+    for (std::size_t i = t; i < blocks_.size(); ++i) {
+        Block& b = blocks_[i];
+        b.end = b.end + source.size() - old.size();
+        b.output_end = b.output_end + rendered.size() - (old_output_end - old_output_begin);
+        b.next_line = b.next_line + line - old_line;
+    }
+    output_.replace(old_output_begin, old_output_end - old_output_begin, rendered.str());
+    blocks_.erase(blocks_.begin() + static_cast<std::ptrdiff_t>(s),
+                  blocks_.begin() + static_cast<std::ptrdiff_t>(t));
+    blocks_.insert(blocks_.begin() + static_cast<std::ptrdiff_t>(s), window.begin(), window.end());
+    source_.assign(source);
+
+    reused_ = blocks_.size() - window.size();
+    rendered_ = window.size();
+    out.append(output_);
+}
+
+void IncrementalRenderer::relayout(const Emitter& emitter, OutputBuffer& out) {
+    emitter_ = emitter;
+    OutputBuffer rendered;
+    rendered.reserve(output_.size());
+    for (std::size_t i = 0; i < blocks_.size(); ++i) {
+        const std::size_t begin = block_begin(i);
+        render_block(std::string_view(source_).substr(begin, blocks_[i].end - begin),
+                     first_line(i), rendered);
+        blocks_[i].output_end = rendered.size();
+    }
+    output_ = rendered.take();
+    out.append(output_);
+}
+
+#ifdef __linux__
+
+namespace {
+
+constexpr std::string_view kClearScreen = "\x1b[H\x1b[2J\x1b[3J";
+// Editors often save in several steps; wait this long for the burst to end
+constexpr int kSettleMillis = 30;
+
+bool names_target(int fd, const std::string& name) {
+    alignas(inotify_event) char buf[16 * 1024];
+    bool hit = false;
+    for (;;) {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return hit;
+            throw std::runtime_error(std::string("inotify read failed: ") +
+                                     std::strerror(errno));
+        }
+        for (char* p = buf; p < buf + n;) {
+            auto* ev = reinterpret_cast<inotify_event*>(p);
+            if (ev->len != 0 && name == ev->name) hit = true;
+            p += sizeof(inotify_event) + ev->len;
+        }
+    }
+}
+
+// Columns of the terminal on stdout, or 0 when it is not one
+std::size_t terminal_width() {
+    winsize ws{};
+    if (::ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0) return 0;
+    return ws.ws_col;
+}
+
+// SIGWINCH as a pollable descriptor, or -1
+int resize_signal_fd() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    if (::sigprocmask(SIG_BLOCK, &mask, nullptr) < 0) return -1;
+    return ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+void drain(int fd) {
+    signalfd_siginfo info;
+    while (::read(fd, &info, sizeof info) > 0) {}
+}
+
+} // namespace
+
+void watch_file(const std::string& path, const Emitter& emitter, OutputBuffer& out,
+                bool fit_terminal) {
+    // Watch the directory: editors that save by renaming a new file over the
+    // old one would otherwise leave us watching a deleted inode
+    namespace fs = std::filesystem;
+    fs::path target(path);
+    std::string dir = target.has_parent_path() ? target.parent_path().string() : ".";
+    std::string name = target.filename().string();
+
+    int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("inotify_init1 failed");
+    if (::inotify_add_watch(fd, dir.c_str(),
+                            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY) < 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to watch directory: " + dir);
+    }
+
+    std::size_t width = fit_terminal ? terminal_width() : 0;
+    const int resize_fd = width != 0 ? resize_signal_fd() : -1;
+    IncrementalRenderer renderer(width != 0 ? emitter.with_width(width) : emitter);
+    auto redraw = [&] {
+        std::string source;
+        try {
+            source = read_file(path);
+        } catch (const std::exception&) {
+            // Mid-save the file can briefly be missing; the next event retries
+            return;
+        }
+        out.append(kClearScreen);
+        renderer.render(source, out);
+        out.flush();
+    };
+
+    redraw();
+    pollfd pfds[2] = {{fd, POLLIN, 0}, {resize_fd, POLLIN, 0}};
+    const nfds_t nfds = resize_fd >= 0 ? 2 : 1;
+    for (;;) {
+        if (::poll(pfds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (nfds == 2 && (pfds[1].revents & POLLIN)) {
+            drain(resize_fd);
+            // Only the line breaks depend on the width; the source is unchanged
+            const std::size_t now = terminal_width();
+            if (now != 0 && now != width) {
+                width = now;
+                out.append(kClearScreen);
+                renderer.relayout(emitter.with_width(width), out);
+                out.flush();
+            }
+        }
+        if (!(pfds[0].revents & POLLIN)) continue;
+        bool changed = names_target(fd, name);
+        while (::poll(pfds, 1, kSettleMillis) > 0)
+            changed = names_target(fd, name) || changed;
+        if (changed) redraw();
+    }
+    if (resize_fd >= 0) ::close(resize_fd);
+    ::close(fd);
+    throw std::runtime_error("Stopped watching " + path);
+}
+
+#else
+
+void watch_file(const std::string&, const Emitter&, OutputBuffer&, bool) {
+    throw std::runtime_error("--watch is only supported on Linux (inotify)");
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include "corpus.hpp"
+#include "emitter.hpp"
+#include "lexer.hpp"
+#include "output_buffer.hpp"
+#include "parser.hpp"
+#include "pipeline.hpp"
+#include "render_context.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+
+// Fails when a pipeline stage allocates more, per KB of input, than its
+// budget below. Every stage runs once untimed first, so per-thread scratch
+// buffers that are reused across documents are not charged to it.
+//
+// A RenderContext that has already rendered an input must render it again
+// without allocating at all.
+//
+// When a change legitimately needs more, raise the budget in the same commit
+// and say why; when it needs less, lower it so the gain is kept.
+
+namespace {
+
+struct Counts {
+  std::size_t allocations = 0;
+  std::size_t bytes = 0;
+};
+
+bool g_counting = false;
+Counts g_counts;
+
+void *allocate(std::size_t size, std::size_t align) {
+  if (g_counting) {
+    ++g_counts.allocations;
+    g_counts.bytes += size;
+  }
+  void *p = align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                ? std::malloc(size == 0 ? 1 : size)
+                : std::aligned_alloc(align, (size + align - 1) / align * align);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+} // namespace
+
+void *operator new(std::size_t n) { return allocate(n, 0); }
+void *operator new[](std::size_t n) { return allocate(n, 0); }
+void *operator new(std::size_t n, std::align_val_t a) {
+  return allocate(n, static_cast<std::size_t>(a));
+}
+void *operator new[](std::size_t n, std::align_val_t a) {
+  return allocate(n, static_cast<std::size_t>(a));
+}
+void *operator new(std::size_t n, const std::nothrow_t &) noexcept try {
+  return allocate(n, 0);
+} catch (...) {
+  return nullptr;
+}
+void *operator new[](std::size_t n, const std::nothrow_t &) noexcept try {
+  return allocate(n, 0);
+} catch (...) {
+  return nullptr;
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+constexpr std::size_t kCorpusBytes = 256 << 10;
+// Matches SKIP_RETURN_CODE in CMakeLists.txt
+[[maybe_unused]] constexpr int kSkipped = 77;
+
+struct Budget {
+  std::string_view corpus;
+  std::string_view stage;
+  double allocations_per_kb;
+  double bytes_per_kb;
+};
+
+// clang-format off
+constexpr Budget kBudgets[] = {
+    {"prose",    "lex",        0.2,  1500},
+    {"prose",    "parse",      0.2,  14000},
+    {"prose",    "emit",       0.05, 1600},
+    {"prose",    "end_to_end", 0.25, 19000},
+    {"prose",    "context",    0,    0},
+    {"markup",   "lex",        0.2,  11500},
+    {"markup",   "parse",      0.2,  27000},
+    {"markup",   "emit",       0.05, 4800},
+    {"markup",   "end_to_end", 0.25, 32000},
+    {"markup",   "context",    0,    0},
+    {"nested",   "lex",        0.2,  11500},
+    {"nested",   "parse",      0.2,  27000},
+    {"nested",   "emit",       0.05, 1600},
+    {"nested",   "end_to_end", 0.25, 29000},
+    {"nested",   "context",    0,    0},
+    {"code",     "lex",        0.2,  5800},
+    {"code",     "parse",      0.15, 1300},
+    {"code",     "emit",       0.05, 1600},
+    {"code",     "end_to_end", 0.2,  6300},
+    {"code",     "context",    0,    0},
+    {"headings", "lex",        0.2,  2900},
+    {"headings", "parse",      0.2,  12500},
+    {"headings", "emit",       0.05, 4800},
+    {"headings", "end_to_end", 0.25, 22000},
+    {"headings", "context",    0,    0},
+};
+// clang-format on
+
+const Budget *find_budget(std::string_view corpus, std::string_view stage) {
+  for (const Budget &b : kBudgets)
+    if (b.corpus == corpus && b.stage == stage)
+      return &b;
+  return nullptr;
+}
+
+// Runs `body` once to warm up, then again with counting on
+template <class Body> Counts measure(Body body) {
+  body();
+  g_counts = {};
+  g_counting = true;
+  body();
+  g_counting = false;
+  return g_counts;
+}
+
+} // namespace
+
+int main() {
+#ifdef TERMINYL_STATS
+  // Stats builds lex into a TokenBuffer first, so end_to_end differs
+  std::printf("skipped: budgets are for builds without TERMINYL_STATS\n");
+  return kSkipped;
+#endif
+  const Emitter emitter;
+  RenderContext context;
+  int failures = 0;
+
+  std::printf("%-9s %-11s %12s %12s %12s %12s\n", "corpus", "stage",
+              "allocs/KB", "budget", "bytes/KB", "budget");
+  for (const CorpusInfo &info : corpus_mixes()) {
+    const std::string source = generate_corpus(info.mix, kCorpusBytes);
+    const double kb = static_cast<double>(source.size()) / 1024;
+    const TokenBuffer tokens = Lexer(source).lexTokens();
+    const Document doc = Parser(tokens).parse();
+
+    auto check = [&](std::string_view stage, Counts c) {
+      const double allocs = static_cast<double>(c.allocations) / kb;
+      const double bytes = static_cast<double>(c.bytes) / kb;
+      const Budget *budget = find_budget(info.name, stage);
+      const bool ok = budget != nullptr &&
+                      allocs <= budget->allocations_per_kb &&
+                      bytes <= budget->bytes_per_kb;
+      std::printf("%-9.*s %-11.*s %12.2f %12.2f %12.1f %12.1f%s\n",
+                  static_cast<int>(info.name.size()), info.name.data(),
+                  static_cast<int>(stage.size()), stage.data(), allocs,
+                  budget ? budget->allocations_per_kb : 0.0, bytes,
+                  budget ? budget->bytes_per_kb : 0.0,
+                  ok ? "" : "  OVER BUDGET");
+      if (!ok)
+        ++failures;
+    };
+
+    check("lex", measure([&] { Lexer(source).lexTokens(); }));
+    check("parse", measure([&] { Parser(tokens).parse(); }));
+    check("emit", measure([&] { emitter.render_to_string(doc); }));
+    check("end_to_end", measure([&] {
+            OutputBuffer out;
+            render_source(out, source, emitter);
+          }));
+    // The first render sizes the context for this corpus
+    context.render(source);
+    check("context", measure([&] { context.render(source); }));
+  }
+
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,101 @@
+#include "corpus.hpp"
+#include "heading_index.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// index_headings finds headings without lexing; checks that it finds exactly
+// the ones the parser does, at the same offsets and with the same titles.
+
+namespace {
+
+constexpr std::size_t kCorpusBytes = 256 << 10;
+constexpr int kRandomDocuments = 20000;
+
+std::string_view trim(std::string_view s) {
+  const std::size_t first = s.find_first_not_of(' ');
+  if (first == std::string_view::npos)
+    return {};
+  return s.substr(first, s.find_last_not_of(' ') - first + 1);
+}
+
+bool matches_parser(std::string_view source) {
+  Lexer lex(source);
+  const Document doc = Parser(lex).parse();
+  std::vector<const Document::Heading *> parsed;
+  for (const Document::Block &b : doc.blocks())
+    if (const auto *h = std::get_if<Document::Heading>(&b))
+      parsed.push_back(h);
+
+  const std::vector<HeadingEntry> indexed = index_headings(source);
+  if (indexed.size() != parsed.size())
+    return false;
+  for (std::size_t i = 0; i < parsed.size(); ++i) {
+    if (indexed[i].offset != parsed[i]->range.begin ||
+        indexed[i].level != parsed[i]->level ||
+        indexed[i].title != trim(parsed[i]->text))
+      return false;
+  }
+  return true;
+}
+
+// Short documents built from the pieces that matter to block structure
+std::string random_document(std::mt19937 &rng) {
+  static constexpr std::string_view kAtoms[] = {
+      "foo", "bar baz", " ", "\n", "\n\n", "*", "_", "`", "= ", "== head",
+      "(", ",", "=", "x"};
+  std::string s;
+  for (unsigned n = rng() % 60; n != 0; --n)
+    s += kAtoms[rng() % std::size(kAtoms)];
+  return s;
+}
+
+} // namespace
+
+int main() {
+  int failures = 0;
+  auto check = [&](std::string_view name, std::string_view source) {
+    if (matches_parser(source))
+      return;
+    std::printf("mismatch: %.*s\n", static_cast<int>(name.size()), name.data());
+    ++failures;
+  };
+  // Same, and also pins down how many headings there are
+  auto expect = [&](std::string_view name, std::string_view source,
+                    std::size_t headings) {
+    check(name, source);
+    if (index_headings(source).size() == headings)
+      return;
+    std::printf("wrong heading count: %.*s\n", static_cast<int>(name.size()),
+                name.data());
+    ++failures;
+  };
+
+  // A backtick with no closer before the end of the source is literal
+  expect("unmatched backtick at end", "intro `tick\n= Last\nbody\n", 1);
+  expect("unmatched backtick, no newline", "= First\nintro `tick\n= Last", 2);
+  expect("code span across a line", "a `b\n= c` d\n= Real\n", 1);
+  // So is a delimiter that never closes, which leaves the lines apart
+  expect("unmatched delimiter", "a *b\n= Title\n\n= Next\n", 2);
+  expect("delimiter closing a line later", "a *b\n= c* d\n= Real\n", 1);
+  expect("delimiter closing past a heading", "a *b\n= Title\nc*\n", 0);
+
+  for (const CorpusInfo &info : corpus_mixes())
+    check(info.name, generate_corpus(info.mix, kCorpusBytes));
+
+  std::mt19937 rng(42);
+  for (int i = 0; i < kRandomDocuments; ++i) {
+    const std::string source = random_document(rng);
+    if (!matches_parser(source)) {
+      std::printf("mismatch on random document:\n%s\n---\n", source.c_str());
+      ++failures;
+    }
+  }
+
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}